@@ -1,14 +1,24 @@
 #include "ScreenCapture.h"
 #include "internal/SCCommon.h" //DONT USE THIS HEADER IN PRODUCTION CODE!!!! ITS INTERNAL FOR A REASON IT WILL CHANGE!!! ITS HERE FOR TESTS ONLY!!!
+#include "internal/DiffKernels.h"
+#include "internal/WorkerPool.h"
 #include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <climits>
+#include <cstdlib>
 #include <iostream>
 #include <locale>
+#include <new>
 #include <string>
 #include <thread>
 #include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 // THESE LIBRARIES ARE HERE FOR CONVINIENCE!! They are SLOW and ONLY USED FOR
 // HOW THE LIBRARY WORKS!
@@ -38,6 +48,22 @@ void ExtractAndConvertToRGBA(const SL::Screen_Capture::Image &img, unsigned char
 }
 
 using namespace std::chrono_literals;
+// every allocation made by the program is counted so the diff can be checked to not allocate
+std::atomic<size_t> allocationcounter;
+static void *CountedAllocation(size_t size)
+{
+    allocationcounter += 1;
+    if (auto p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void *operator new(size_t size) { return CountedAllocation(size); }
+void *operator new[](size_t size) { return CountedAllocation(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
 std::shared_ptr<SL::Screen_Capture::IScreenCaptureManager> framgrabber;
 std::atomic<int> realcounter;
 std::atomic<int> onNewFramecounter;
@@ -79,6 +105,12 @@ void createframegrabber()
                          tje_encode_to_file(s.c_str(), Width(img), Height(img), 4, (const unsigned char*)imgbuffer.get());
                 */
             })
+            ->onFrameDirtyRegions([&](const SL::Screen_Capture::Image &img, const SL::Screen_Capture::DirtyRegions &regions,
+                                      const SL::Screen_Capture::Monitor &monitor) {
+                // img is the whole frame and every changed rect is in regions, so this is called once per frame
+                // std::cout << "Frame " << regions.FrameSequence << " has " << regions.Count << " changed rects" << std::endl;
+                // encoders that do their own tiling can use the changed tiles directly, regions.Tiles.isDirty(row, column)
+            })
             ->onNewFrame([&](const SL::Screen_Capture::Image &img, const SL::Screen_Capture::Monitor &monitor) {
                 // Uncomment the below code to write the image to disk for debugging
                 /*
@@ -268,6 +300,765 @@ void createwindowgrabber()
     framgrabber->setMouseChangeInterval(std::chrono::milliseconds(100));
 }
 
+void BenchmarkGetDifs(const char *name, int width, int height)
+{
+    std::vector<SL::Screen_Capture::ImageBGRA> image1, image2;
+    image1.resize(height * width);
+    for (auto &a : image1) {
+        a.B = static_cast<unsigned short>(std::rand() % 255);
+        a.A = static_cast<unsigned short>(std::rand() % 255);
+        a.G = static_cast<unsigned short>(std::rand() % 255);
+        a.R = static_cast<unsigned short>(std::rand() % 255);
+    }
+    image2.resize(height * width);
+    for (auto &a : image2) {
+        a.B = static_cast<unsigned short>(std::rand() % 255);
+        a.A = static_cast<unsigned short>(std::rand() % 255);
+        a.G = static_cast<unsigned short>(std::rand() % 255);
+        a.R = static_cast<unsigned short>(std::rand() % 255);
+    }
+    auto oldimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data());
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+
+    long long durationaverage = 0;
+    long long smallestduration = INT_MAX;
+    for (auto i = 0; i < 100; i++) { // run a few times to get an average
+        auto starttime = std::chrono::high_resolution_clock::now();
+        auto difs = SL::Screen_Capture::GetDifs(oldimg, newimg);
+        long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+        smallestduration = std::min(d, smallestduration);
+        durationaverage += d;
+    }
+    durationaverage /= 100;
+    std::cout << name << " Best Case -- Time to get diffs " << durationaverage << " microseconds" << std::endl;
+    std::cout << name << " Best Case -- Lowest Time " << smallestduration << " microseconds" << std::endl;
+    memset(image1.data(), 5, image1.size() * sizeof(SL::Screen_Capture::ImageBGRA));
+    memset(image2.data(), 5, image2.size() * sizeof(SL::Screen_Capture::ImageBGRA));
+
+    durationaverage = 0;
+    smallestduration = INT_MAX;
+    for (auto i = 0; i < 100; i++) { // run a few times to get an average
+        auto starttime = std::chrono::high_resolution_clock::now();
+        auto difs = SL::Screen_Capture::GetDifs(oldimg, newimg);
+        long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+        smallestduration = std::min(d, smallestduration);
+        durationaverage += d;
+    }
+    durationaverage /= 100;
+    std::cout << name << " Worst Case -- Time to get diffs " << durationaverage << " microseconds" << std::endl;
+    std::cout << name << " Worst Case -- Lowest Time " << smallestduration << " microseconds" << std::endl;
+
+    // the worst case is a full scan of the frame so compare the raw kernels against each other on that
+    const char *instructionsetnames[] = {"Scalar", "SSE2", "AVX2"};
+    for (auto instructionset :
+         {SL::Screen_Capture::DiffInstructionSet::Scalar, SL::Screen_Capture::DiffInstructionSet::SSE2, SL::Screen_Capture::DiffInstructionSet::AVX2}) {
+        auto kernels = SL::Screen_Capture::GetDiffKernels(instructionset);
+        if (kernels.InstructionSet != instructionset) {
+            continue; // not supported on this cpu
+        }
+        smallestduration = INT_MAX;
+        for (auto i = 0; i < 100; i++) {
+            auto starttime = std::chrono::high_resolution_clock::now();
+            for (auto row = 0; row < height; row++) {
+                kernels.Compare(image1.data() + row * width, image2.data() + row * width, width);
+            }
+            long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+            smallestduration = std::min(d, smallestduration);
+        }
+        std::cout << name << " " << instructionsetnames[static_cast<int>(instructionset)] << " compare kernel -- Lowest Time " << smallestduration
+                  << " microseconds" << std::endl;
+    }
+}
+
+void BenchmarkGetDifsThreads(const char *name, int width, int height)
+{
+    // identical frames are the worst case since every byte has to be compared
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    auto oldimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data());
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    const auto maxthreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for (auto threads = 1; threads <= maxthreads; threads++) {
+        SL::Screen_Capture::WorkerPool workers(threads - 1);
+        SL::Screen_Capture::DiffOptions options;
+        options.Threads = threads;
+        long long smallestduration = INT_MAX;
+        for (auto i = 0; i < 100; i++) {
+            auto starttime = std::chrono::high_resolution_clock::now();
+            auto difs = SL::Screen_Capture::GetDifs(oldimg, newimg, options, &workers);
+            long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+            smallestduration = std::min(d, smallestduration);
+        }
+        std::cout << name << " " << threads << " threads -- Lowest Time " << smallestduration << " microseconds" << std::endl;
+    }
+}
+
+void BenchmarkRectMerging(const char *name, int width, int height, int spots, int spotsize, int tilesize)
+{
+    // small changes scattered over the frame, like a blinking cursor, a clock and some icons, or noise all over it
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    for (auto spot = 0; spot < spots; spot++) {
+        auto left = std::rand() % (width - spotsize), top = std::rand() % (height - spotsize);
+        for (auto row = top; row < top + 1 + std::rand() % spotsize; row++) {
+            for (auto col = left; col < left + 1 + std::rand() % spotsize; col++) {
+                image2[row * width + col].R = 255;
+            }
+        }
+    }
+    auto oldimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data());
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    long long changedpixels = 0;
+    for (auto i = 0; i < width * height; i++) {
+        changedpixels += image2[i].R != 0 ? 1 : 0;
+    }
+
+    // the first setting does not merge anything that adds pixels, the overdraw of the others is measured against it
+    const std::pair<int, float> settings[] = {{0, 1.0f}, {0, 1.5f}, {0, 4.0f}, {16, 1.0f}, {4, 1.0f}, {1, 1.0f}};
+    long long unmergedpixels = 0;
+    for (auto &setting : settings) {
+        SL::Screen_Capture::DiffOptions options;
+        options.TileWidth = options.TileHeight = tilesize;
+        options.TightRects = true;
+        options.MaxRects = setting.first;
+        options.MaxOverdraw = setting.second;
+        std::vector<SL::Screen_Capture::ImageRect> difs;
+        long long smallestduration = INT_MAX;
+        for (auto i = 0; i < 20; i++) {
+            auto starttime = std::chrono::high_resolution_clock::now();
+            difs = SL::Screen_Capture::GetDifs(oldimg, newimg, options);
+            long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+            smallestduration = std::min(d, smallestduration);
+        }
+        // every changed pixel still has to be sent
+        std::vector<char> covered(height * width);
+        long long sentpixels = 0;
+        for (auto &r : difs) {
+            sentpixels += static_cast<long long>(SL::Screen_Capture::Width(r)) * SL::Screen_Capture::Height(r);
+            for (auto row = r.top; row < r.bottom; row++) {
+                std::fill(covered.begin() + row * width + r.left, covered.begin() + row * width + r.right, 1);
+            }
+        }
+        for (auto i = 0; i < width * height; i++) {
+            assert(covered[i] || image2[i].R == 0);
+        }
+        assert(setting.first == 0 || difs.size() <= static_cast<size_t>(setting.first));
+        if (&setting == settings) {
+            unmergedpixels = sentpixels;
+        }
+        assert(setting.first != 0 || sentpixels <= setting.second * unmergedpixels);
+        std::cout << name << " max rects " << setting.first << " max overdraw " << setting.second << " -- " << difs.size() << " callbacks, "
+                  << sentpixels << " pixels sent for " << changedpixels << " changed, Lowest Time " << smallestduration << " microseconds"
+                  << std::endl;
+    }
+}
+
+void BenchmarkCheckerboard(const char *name, int width, int height, int tilesize)
+{
+    // every other tile changed, the most rects small tiles can give since none of them can be merged
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    for (auto row = 0; row < height; row++) {
+        for (auto col = 0; col < width; col++) {
+            image2[row * width + col].R = (row / tilesize + col / tilesize) % 2 ? 255 : 0;
+        }
+    }
+    auto oldimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data());
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    SL::Screen_Capture::DiffOptions options;
+    options.TileWidth = options.TileHeight = tilesize;
+    SL::Screen_Capture::DiffContext context;
+    long long smallestduration = INT_MAX;
+    for (auto i = 0; i < 20; i++) {
+        auto starttime = std::chrono::high_resolution_clock::now();
+        SL::Screen_Capture::GetDifs(context, oldimg, newimg, options);
+        long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+        smallestduration = std::min(d, smallestduration);
+    }
+    const auto tiles = SL::Screen_Capture::TileCount(SL::Screen_Capture::ImageRect(0, 0, width, height), options);
+    assert(context.Rects.size() == (tiles + 1) / 2);
+    std::cout << name << " checkerboard of " << tilesize << " pixel tiles -- " << context.Rects.size() << " rects, Lowest Time " << smallestduration
+              << " microseconds" << std::endl;
+}
+
+void TestMoveDetection(int width, int height)
+{
+    // a page that scrolls up by 37 pixels next to a sidebar that does not, with new content coming in at the bottom
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2, rebuilt;
+    for (auto &a : image1) {
+        a.B = static_cast<unsigned char>(std::rand() % 255);
+        a.G = static_cast<unsigned char>(std::rand() % 255);
+        a.R = static_cast<unsigned char>(std::rand() % 255);
+    }
+    image2 = image1;
+    const auto sidebar = 300, scroll = 37;
+    for (auto row = 0; row < height; row++) {
+        for (auto col = sidebar; col < width; col++) {
+            image2[row * width + col] = row + scroll < height ? image1[(row + scroll) * width + col] : SL::Screen_Capture::ImageBGRA{1, 2, 3, 0};
+        }
+    }
+    rebuilt = image1;
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    SL::Screen_Capture::DiffOptions options;
+    options.TileWidth = options.TileHeight = 64;
+    options.Moves = SL::Screen_Capture::DiffMoves::Vertical;
+    SL::Screen_Capture::DiffContext context;
+    auto &difs = SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+
+    // what a client would do with the moves and the rects
+    long long changedpixels = 0;
+    for (auto &move : context.Moves) {
+        auto copy = rebuilt;
+        for (auto row = move.Source.top; row < move.Source.bottom; row++) {
+            for (auto col = move.Source.left; col < move.Source.right; col++) {
+                rebuilt[(row + move.DeltaY) * width + col + move.DeltaX] = copy[row * width + col];
+            }
+        }
+    }
+    for (auto &r : difs) {
+        changedpixels += static_cast<long long>(SL::Screen_Capture::Width(r)) * SL::Screen_Capture::Height(r);
+        for (auto row = r.top; row < r.bottom; row++) {
+            std::copy(image2.begin() + row * width + r.left, image2.begin() + row * width + r.right, rebuilt.begin() + row * width + r.left);
+        }
+    }
+    std::cout << "Scrolled frame -- " << context.Moves.size() << " moves, " << changedpixels << " of " << width * height << " pixels changed"
+              << std::endl;
+    assert(!context.Moves.empty() && context.Moves[0].DeltaY == -scroll);
+    assert(changedpixels < width * height / 4);
+    assert(memcmp(rebuilt.data(), image2.data(), image2.size() * sizeof(SL::Screen_Capture::ImageBGRA)) == 0);
+    assert(memcmp(image1.data(), image2.data(), image2.size() * sizeof(SL::Screen_Capture::ImageBGRA)) == 0);
+}
+
+void TestAlphaIgnored(int width, int height)
+{
+    // the same colors with different garbage in alpha must not be reported as a change
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2;
+    for (auto &a : image1) {
+        a.B = static_cast<unsigned char>(std::rand() % 255);
+        a.G = static_cast<unsigned char>(std::rand() % 255);
+        a.R = static_cast<unsigned char>(std::rand() % 255);
+    }
+    image2 = image1;
+    for (auto &a : image2) {
+        a.A = static_cast<unsigned char>(std::rand() % 255);
+    }
+    auto oldimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data());
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    for (auto instructionset :
+         {SL::Screen_Capture::DiffInstructionSet::Scalar, SL::Screen_Capture::DiffInstructionSet::SSE2, SL::Screen_Capture::DiffInstructionSet::AVX2}) {
+        auto kernels = SL::Screen_Capture::GetDiffKernels(instructionset);
+        size_t first, last;
+        for (auto row = 0; row < height; row++) {
+            // odd lengths go through the tail handling of each kernel too
+            for (auto npixels : {width, width - 1, width - 3}) {
+                assert(!kernels.Compare(image1.data() + row * width, image2.data() + row * width, npixels));
+                assert(!kernels.FindChanges(image1.data() + row * width, image2.data() + row * width, npixels, first, last));
+                assert(kernels.Hash(0, image1.data() + row * width, npixels) == kernels.Hash(0, image2.data() + row * width, npixels));
+            }
+        }
+    }
+    SL::Screen_Capture::DiffOptions options;
+    options.TightRects = true;
+    auto difs = SL::Screen_Capture::GetDifs(oldimg, newimg, options);
+    std::cout << "Alpha only changes -- " << difs.size() << " rects" << std::endl;
+    assert(difs.empty());
+
+    // but a change to a color next to it still is
+    image2[width + 5].G ^= 1;
+    difs = SL::Screen_Capture::GetDifs(oldimg, newimg, options);
+    assert(difs.size() == 1 && difs[0].left == 5 && difs[0].top == 1 && difs[0].right == 6 && difs[0].bottom == 2);
+}
+
+void TestHeatWithMoves(int width, int height)
+{
+    // a page that scrolls down every frame with new content coming in at the top, so the top tiles get too hot to be reported. Moving what the
+    // client has of them down would spread the changes it never got
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2, rebuilt;
+    for (auto &a : image1) {
+        a.B = static_cast<unsigned char>(std::rand() % 255);
+        a.G = static_cast<unsigned char>(std::rand() % 255);
+        a.R = static_cast<unsigned char>(std::rand() % 255);
+    }
+    image2 = rebuilt = image1;
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    SL::Screen_Capture::DiffOptions options;
+    options.TileWidth = options.TileHeight = 64;
+    options.Moves = SL::Screen_Capture::DiffMoves::Vertical;
+    options.HeatDecay = 0.5f;
+    options.MaxHeat = 0.7f;
+    SL::Screen_Capture::DiffContext context;
+    const auto scroll = 8;
+    size_t moves = 0;
+    // it scrolls for a while and then stops, once every tile has cooled down the client has to have all of the frame
+    for (auto frame = 0; frame < 20; frame++) {
+        for (auto row = height - 1; frame < 12 && row >= 0; row--) {
+            for (auto col = 0; col < width; col++) {
+                auto &a = image2[row * width + col];
+                if (row >= scroll) {
+                    a = image2[(row - scroll) * width + col];
+                }
+                else {
+                    a.B = static_cast<unsigned char>(std::rand() % 255);
+                    a.G = static_cast<unsigned char>(frame);
+                }
+            }
+        }
+        auto &difs = SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+        moves += context.Moves.size();
+        for (auto &move : context.Moves) {
+            auto copy = rebuilt;
+            for (auto row = move.Source.top; row < move.Source.bottom; row++) {
+                for (auto col = move.Source.left; col < move.Source.right; col++) {
+                    rebuilt[(row + move.DeltaY) * width + col + move.DeltaX] = copy[row * width + col];
+                }
+            }
+        }
+        for (auto &r : difs) {
+            for (auto row = r.top; row < r.bottom; row++) {
+                std::copy(image2.begin() + row * width + r.left, image2.begin() + row * width + r.right, rebuilt.begin() + row * width + r.left);
+            }
+        }
+    }
+    std::cout << "Scrolling with hot tiles -- " << moves << " moves" << std::endl;
+    assert(memcmp(rebuilt.data(), image2.data(), image2.size() * sizeof(SL::Screen_Capture::ImageBGRA)) == 0);
+}
+
+void TestDiffThreshold(int width, int height)
+{
+    const unsigned char threshold = 4;
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2;
+    for (auto &a : image1) {
+        a.B = static_cast<unsigned char>(threshold + std::rand() % (255 - 2 * threshold));
+        a.G = static_cast<unsigned char>(threshold + std::rand() % (255 - 2 * threshold));
+        a.R = static_cast<unsigned char>(threshold + std::rand() % (255 - 2 * threshold));
+    }
+    // noise of up to the threshold in every color, and garbage in alpha
+    image2 = image1;
+    for (auto &a : image2) {
+        a.B = static_cast<unsigned char>(a.B + std::rand() % (2 * threshold + 1) - threshold);
+        a.G = static_cast<unsigned char>(a.G + std::rand() % (2 * threshold + 1) - threshold);
+        a.R = static_cast<unsigned char>(a.R + std::rand() % (2 * threshold + 1) - threshold);
+        a.A = static_cast<unsigned char>(std::rand() % 255);
+    }
+    for (auto instructionset : {SL::Screen_Capture::DiffInstructionSet::Scalar, SL::Screen_Capture::DiffInstructionSet::SSE2,
+                                SL::Screen_Capture::DiffInstructionSet::AVX2}) {
+        auto kernels = SL::Screen_Capture::GetDiffKernels(instructionset);
+        size_t first, last;
+        for (auto row = 0; row < height; row++) {
+            const auto a = image1.data() + row * width;
+            const auto b = image2.data() + row * width;
+            for (auto npixels : {width, width - 1, width - 3}) {
+                assert(!kernels.CompareThreshold(a, b, npixels, threshold));
+                assert(!kernels.FindChangesThreshold(a, b, npixels, threshold, first, last));
+            }
+        }
+        // one color just over the threshold anywhere in a row is found, including in the tail the vectors do not cover
+        auto row = std::vector<SL::Screen_Capture::ImageBGRA>(image2.begin(), image2.begin() + width);
+        for (auto col : {0, width / 2, width - 2, width - 1}) {
+            const auto old = row[col].R;
+            row[col].R = static_cast<unsigned char>(image1[col].R + threshold + 1);
+            assert(kernels.CompareThreshold(image1.data(), row.data(), width, threshold));
+            assert(kernels.FindChangesThreshold(image1.data(), row.data(), width, threshold, first, last));
+            assert(first == static_cast<size_t>(col) && last == static_cast<size_t>(col));
+            row[col].R = old;
+        }
+    }
+
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    for (auto tightrects : {false, true}) {
+        SL::Screen_Capture::DiffOptions options;
+        options.Threshold = threshold;
+        options.TightRects = tightrects;
+        SL::Screen_Capture::DiffContext context;
+        auto reference = image1;
+        auto frame = image2;
+        newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, frame.data());
+        auto difs = SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(reference.data()), newimg, options);
+        std::cout << "Noise under the threshold, tight rects " << tightrects << " -- " << difs.size() << " rects" << std::endl;
+        assert(difs.empty());
+
+        // a slow fade is not lost, it is reported once it adds up to more than the threshold
+        auto fades = 0;
+        while (difs.empty()) {
+            frame[width + 1].G = static_cast<unsigned char>(frame[width + 1].G + 1);
+            difs = SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(reference.data()), newimg, options);
+            fades++;
+        }
+        assert(fades <= 2 * threshold + 1 && difs.size() == 1 && difs[0].Contains(SL::Screen_Capture::ImageRect(1, 1, 2, 2)));
+        assert(reference[width + 1].G == frame[width + 1].G);
+        // without tight rects the whole tile is reported, so all of it is brought up to date, noise and all
+        for (auto r = 0; !tightrects && r < options.TileHeight; r++) {
+            assert(std::memcmp(&reference[r * width], &frame[r * width], options.TileWidth * sizeof(SL::Screen_Capture::ImageBGRA)) == 0);
+        }
+    }
+}
+
+void TestDiffSampling(int width, int height)
+{
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    const auto getdifs = [&](SL::Screen_Capture::DiffContext &context, const SL::Screen_Capture::DiffOptions &options) -> const auto & {
+        return options.Reference == SL::Screen_Capture::DiffReference::Pixels
+                   ? SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options)
+                   : SL::Screen_Capture::GetHashDifsAndUpdate(context, nullptr, newimg, options);
+    };
+    for (auto reference : {SL::Screen_Capture::DiffReference::Pixels, SL::Screen_Capture::DiffReference::TileHashes}) {
+        SL::Screen_Capture::DiffOptions options;
+        options.Reference = reference;
+        options.SampleRows = 8;
+        options.FullScanInterval = 30;
+        SL::Screen_Capture::DiffContext context;
+        getdifs(context, options);
+
+        long long sampled = 0, full = 0;
+        for (auto i = 0; i < 100; i++) {
+            auto starttime = std::chrono::high_resolution_clock::now();
+            assert(getdifs(context, options).empty());
+            sampled += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+        }
+        auto fulloptions = options;
+        fulloptions.SampleRows = 0;
+        for (auto i = 0; i < 100; i++) {
+            auto starttime = std::chrono::high_resolution_clock::now();
+            assert(getdifs(context, fulloptions).empty());
+            full += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+        }
+        std::cout << "Static frame, diff reference " << static_cast<int>(reference) << " -- " << full / 100 << " microseconds in full, "
+                  << sampled / 100 << " microseconds sampling every " << options.SampleRows << " rows" << std::endl;
+
+        // a change to a single row is found once the rows checked get to it, without a full diff to fall back on
+        options.FullScanInterval = 0;
+        image2[3 * width + 100].G += 1;
+        auto frames = 1;
+        while (getdifs(context, options).empty()) {
+            assert(frames++ < options.SampleRows);
+        }
+        assert(context.Rects.size() == 1 && context.Rects[0].top == 0 && context.Rects[0].left == 0);
+    }
+}
+
+// counts a hardware cache event of this thread with perf_event_open. Where that is not available (other platforms, or a kernel or container that
+// does not allow it) stop returns -1
+class CacheCounter {
+  public:
+    enum Event { L1Misses, LastLevelReads, LastLevelMisses };
+    explicit CacheCounter(Event event)
+    {
+#if defined(__linux__)
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        const auto cache = event == L1Misses ? PERF_COUNT_HW_CACHE_L1D : PERF_COUNT_HW_CACHE_LL;
+        const auto result = event == LastLevelReads ? PERF_COUNT_HW_CACHE_RESULT_ACCESS : PERF_COUNT_HW_CACHE_RESULT_MISS;
+        const auto op = static_cast<uint64_t>(PERF_COUNT_HW_CACHE_OP_READ);
+        attr.config = static_cast<uint64_t>(cache) | (op << 8) | (static_cast<uint64_t>(result) << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        Fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)event;
+#endif
+    }
+    ~CacheCounter()
+    {
+#if defined(__linux__)
+        if (Fd != -1) {
+            close(Fd);
+        }
+#endif
+    }
+    void start()
+    {
+#if defined(__linux__)
+        if (Fd != -1) {
+            ioctl(Fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(Fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    long long stop()
+    {
+        long long count = -1;
+#if defined(__linux__)
+        if (Fd != -1) {
+            ioctl(Fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(Fd, &count, sizeof(count)) != sizeof(count)) {
+                count = -1;
+            }
+        }
+#endif
+        return count;
+    }
+
+  private:
+    int Fd = -1;
+};
+
+void BenchmarkReferenceLayout(const char *name, int width, int height)
+{
+    // nothing changes, so every pixel of both frames is compared
+    std::vector<SL::Screen_Capture::ImageBGRA> image(height * width), previous(height * width);
+    for (auto &a : image) {
+        a.B = static_cast<unsigned char>(std::rand() % 255);
+        a.G = static_cast<unsigned char>(std::rand() % 255);
+        a.R = static_cast<unsigned char>(std::rand() % 255);
+    }
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image.data());
+    for (auto reference : {SL::Screen_Capture::DiffReference::Pixels, SL::Screen_Capture::DiffReference::TiledPixels}) {
+        for (auto tightrects : {false, true}) {
+            SL::Screen_Capture::DiffOptions options;
+            options.Reference = reference;
+            options.TightRects = tightrects;
+            SL::Screen_Capture::DiffContext context;
+            SL::Screen_Capture::CopyReference(reinterpret_cast<unsigned char *>(previous.data()), newimg, options);
+            long long durationaverage = 0;
+            long long smallestduration = INT_MAX;
+            // the requests that miss L2 are the reads of the last level cache, so L2 misses = last level reads and L2 accesses = L1 misses
+            CacheCounter l1misses(CacheCounter::L1Misses), lastlevelreads(CacheCounter::LastLevelReads),
+                lastlevelmisses(CacheCounter::LastLevelMisses);
+            l1misses.start();
+            lastlevelreads.start();
+            lastlevelmisses.start();
+            for (auto i = 0; i < 100; i++) {
+                auto starttime = std::chrono::high_resolution_clock::now();
+                SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(previous.data()), newimg, options);
+                long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
+                smallestduration = std::min(d, smallestduration);
+                durationaverage += d;
+            }
+            const auto misses = l1misses.stop(), l2misses = lastlevelreads.stop(), l3misses = lastlevelmisses.stop();
+            durationaverage /= 100;
+            std::cout << name << " Reference " << (reference == SL::Screen_Capture::DiffReference::Pixels ? "row by row" : "tile by tile")
+                      << " tight rects " << tightrects << " -- average " << durationaverage << " lowest " << smallestduration << " microseconds";
+            if (misses > 0 && l2misses >= 0 && l3misses >= 0) {
+                std::cout << ", per frame " << misses / 100 << " L1 misses, " << l2misses / 100 << " L2 misses ("
+                          << 100 * l2misses / misses << "% of L2 accesses), " << l3misses / 100 << " last level misses";
+            }
+            else {
+                std::cout << ", cache counters not available";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+void TestTiledReference(int width, int height)
+{
+    // the tiled reference must find exactly the same changes as the one kept row by row, including for the smaller tiles at the edges
+    std::vector<SL::Screen_Capture::ImageBGRA> image(height * width), rows(height * width), tiles(height * width), expected(height * width);
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image.data());
+    for (auto threshold : {0, 2}) {
+        for (auto tightrects : {false, true}) {
+            SL::Screen_Capture::DiffOptions options;
+            options.TileWidth = 64;
+            options.TileHeight = 48;
+            options.TightRects = tightrects;
+            options.Threshold = static_cast<unsigned char>(threshold);
+            auto tiledoptions = options;
+            tiledoptions.Reference = SL::Screen_Capture::DiffReference::TiledPixels;
+            SL::Screen_Capture::DiffContext rowcontext, tilecontext;
+            SL::Screen_Capture::CopyReference(reinterpret_cast<unsigned char *>(rows.data()), newimg, options);
+            SL::Screen_Capture::CopyReference(reinterpret_cast<unsigned char *>(tiles.data()), newimg, tiledoptions);
+            for (auto frame = 0; frame < 10; frame++) {
+                for (auto change = 0; change < 100; change++) {
+                    image[std::rand() % (width * height)].G += static_cast<unsigned char>(1 + std::rand() % 4);
+                }
+                auto rowdifs = SL::Screen_Capture::GetDifsAndUpdate(rowcontext, reinterpret_cast<unsigned char *>(rows.data()), newimg, options);
+                auto tiledifs =
+                    SL::Screen_Capture::GetDifsAndUpdate(tilecontext, reinterpret_cast<unsigned char *>(tiles.data()), newimg, tiledoptions);
+                assert(rowdifs == tiledifs && rowcontext.ChangedTiles == tilecontext.ChangedTiles);
+            }
+            // both copies of the previous frame hold the same pixels
+            SL::Screen_Capture::CopyReference(reinterpret_cast<unsigned char *>(expected.data()),
+                                              SL::Screen_Capture::CreateImage(newimg.Bounds, 0, rows.data()), tiledoptions);
+            assert(std::memcmp(expected.data(), tiles.data(), tiles.size() * sizeof(SL::Screen_Capture::ImageBGRA)) == 0);
+        }
+    }
+}
+
+void TestDiffDamage(int width, int height)
+{
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    for (auto reference : {SL::Screen_Capture::DiffReference::Pixels, SL::Screen_Capture::DiffReference::TiledPixels,
+                           SL::Screen_Capture::DiffReference::TileHashes}) {
+        SL::Screen_Capture::DiffOptions options;
+        options.Reference = reference;
+        SL::Screen_Capture::DiffContext context;
+        const auto getdifs = [&]() -> const auto & {
+            return reference == SL::Screen_Capture::DiffReference::TileHashes
+                       ? SL::Screen_Capture::GetHashDifsAndUpdate(context, nullptr, newimg, options)
+                       : SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+        };
+        SL::Screen_Capture::CopyReference(reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+        getdifs();
+
+        // only the tiles the damage touches are looked at, a change anywhere else is trusted not to have happened
+        image2[10].G += 1;
+        image2[(height - 1) * width + width - 1].G += 1;
+        context.HasDamage = true;
+        context.Damage.push_back(SL::Screen_Capture::ImageRect(5, 5, 20, 20));
+        auto difs = getdifs();
+        assert(difs.size() == 1 && difs[0] == SL::Screen_Capture::ImageRect(0, 0, options.TileWidth, options.TileHeight));
+        assert(!context.HasDamage && context.Damage.empty());
+
+        // no damage means nothing changed
+        image2[10].G += 1;
+        context.HasDamage = true;
+        assert(getdifs().empty());
+
+        // without damage information everything is looked at again
+        difs = getdifs();
+        assert(difs.size() == 2);
+        image2[10].G -= 2;
+        image2[(height - 1) * width + width - 1].G -= 1;
+        getdifs();
+
+        // rows are not sampled when there is damage, a change in a row that would not have been checked this frame is still found
+        options.SampleRows = 8;
+        options.FullScanInterval = 5;
+        const auto row = static_cast<int>(context.SamplePhase + 1) % options.SampleRows + options.SampleRows;
+        image2[row * width + 100].G += 1;
+        context.HasDamage = true;
+        context.Damage.push_back(SL::Screen_Capture::ImageRect(100, row, 101, row + 1));
+        assert(getdifs().size() == 1);
+        image2[row * width + 100].G -= 1;
+        getdifs();
+    }
+}
+
+void TestDiffAllocations(int width, int height)
+{
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    // the pool threads are started up front, after that running a job on them must not allocate either
+    SL::Screen_Capture::WorkerPool pool(3);
+    for (auto threads : {1, 4}) {
+        for (auto reference : {SL::Screen_Capture::DiffReference::Pixels, SL::Screen_Capture::DiffReference::TileHashes,
+                               SL::Screen_Capture::DiffReference::VerifiedTileHashes}) {
+            for (auto tightrects : {false, true}) {
+                SL::Screen_Capture::DiffOptions options;
+                options.TileWidth = options.TileHeight = 64;
+                options.Reference = reference;
+                options.TightRects = tightrects;
+                options.MaxRects = 8;
+                options.MaxOverdraw = 2.0f;
+                options.Moves = SL::Screen_Capture::DiffMoves::Both;
+                options.HeatDecay = 0.9f;
+                options.MaxHeat = 0.5f;
+                options.Threads = threads;
+                auto workers = threads > 1 ? &pool : nullptr;
+                SL::Screen_Capture::DiffContext context;
+                size_t allocations = 0;
+                for (auto frame = 0; frame < 20; frame++) {
+                    // the first two frames let the context grow to fit the most tiles and the most rects a frame can have, after that there is
+                    // a different set of changes every frame
+                    for (auto i = 0; frame == 0 && i < width * height; i++) {
+                        image2[i].G += 1;
+                    }
+                    for (auto row = 0; frame == 1 && row < height; row += options.TileHeight) {
+                        for (auto col = (row / options.TileHeight) % 2 * options.TileWidth; col < width; col += 2 * options.TileWidth) {
+                            image2[row * width + col].B += 1;
+                        }
+                    }
+                    for (auto change = 0; frame > 1 && change < 50; change++) {
+                        image2[std::rand() % (width * height)].R += 1;
+                    }
+                    const auto before = allocationcounter.load();
+                    if (reference == SL::Screen_Capture::DiffReference::Pixels) {
+                        SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options,
+                                                             workers);
+                    }
+                    else {
+                        SL::Screen_Capture::GetHashDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options,
+                                                                 workers);
+                    }
+                    allocations += frame < 2 ? 0 : allocationcounter.load() - before;
+                }
+                std::cout << "Diff reference " << static_cast<int>(reference) << " tight rects " << tightrects << " threads " << threads
+                          << " -- " << allocations << " allocations after the first frames" << std::endl;
+                assert(allocations == 0);
+            }
+        }
+    }
+}
+
+void TestDiffThreads(int width, int height)
+{
+    // splitting a frame into bands across threads must give exactly what one thread gives, the rects, the changed tiles and the updated reference
+    std::vector<SL::Screen_Capture::ImageBGRA> image2(height * width);
+    std::vector<unsigned char> serialreference(height * width * sizeof(SL::Screen_Capture::ImageBGRA)), threadedreference(serialreference.size());
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    SL::Screen_Capture::WorkerPool pool(3);
+    for (auto reference : {SL::Screen_Capture::DiffReference::Pixels, SL::Screen_Capture::DiffReference::TiledPixels,
+                           SL::Screen_Capture::DiffReference::TileHashes, SL::Screen_Capture::DiffReference::VerifiedTileHashes}) {
+        for (auto tightrects : {false, true}) {
+            SL::Screen_Capture::DiffOptions options;
+            options.TileWidth = options.TileHeight = 64;
+            options.Reference = reference;
+            options.TightRects = tightrects;
+            auto threadedoptions = options;
+            threadedoptions.Threads = 4;
+            SL::Screen_Capture::DiffContext serial, threaded;
+            const auto getdifs = [&](SL::Screen_Capture::DiffContext &context, std::vector<unsigned char> &buffer,
+                                     const SL::Screen_Capture::DiffOptions &diffoptions, SL::Screen_Capture::WorkerPool *workers) {
+                if (SL::Screen_Capture::UsesTileHashes(diffoptions)) {
+                    SL::Screen_Capture::GetHashDifsAndUpdate(context, buffer.data(), newimg, diffoptions, workers);
+                }
+                else {
+                    SL::Screen_Capture::GetDifsAndUpdate(context, buffer.data(), newimg, diffoptions, workers);
+                }
+            };
+            SL::Screen_Capture::CopyReference(serialreference.data(), newimg, options);
+            SL::Screen_Capture::CopyReference(threadedreference.data(), newimg, options);
+            for (auto frame = 0; frame < 10; frame++) {
+                for (auto change = 0; change < 200; change++) {
+                    image2[std::rand() % (width * height)].R += 1;
+                }
+                getdifs(serial, serialreference, options, nullptr);
+                getdifs(threaded, threadedreference, threadedoptions, &pool);
+                assert(serial.Rects == threaded.Rects);
+                assert(serial.ChangedTiles == threaded.ChangedTiles);
+                assert(serial.TileHashes == threaded.TileHashes);
+                assert(serialreference == threadedreference);
+            }
+        }
+    }
+    std::cout << "Diffs on 4 threads are the same as on one" << std::endl;
+}
+
+void TestHeatMap(int width, int height)
+{
+    std::vector<SL::Screen_Capture::ImageBGRA> image1(height * width), image2(height * width);
+    auto newimg = SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data());
+    SL::Screen_Capture::DiffOptions options;
+    options.HeatDecay = 0.5f;
+    options.MaxHeat = 0.7f;
+    SL::Screen_Capture::DiffContext context;
+    const auto clock = SL::Screen_Capture::ImageRect(0, 0, options.TileWidth, options.TileHeight);
+    const auto covered = [&](const SL::Screen_Capture::ImageRect &rect) {
+        return std::any_of(context.Rects.begin(), context.Rects.end(), [&](const SL::Screen_Capture::ImageRect &r) { return r.Contains(rect); });
+    };
+    // the first tile changes every frame like a clock would, the tile next to it only changes once
+    for (auto frame = 0; frame < 10; frame++) {
+        image2[frame].G += 1;
+        image2[options.TileWidth].R += frame == 0 ? 1 : 0;
+        SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+        // its heat goes from 0.5 to 0.75 on the second frame, which is over 0.7 so it is not reported any more
+        assert(covered(clock) == (frame == 0));
+        assert(covered(SL::Screen_Capture::ImageRect(options.TileWidth, 0, options.TileWidth + 1, 1)) == (frame == 0));
+    }
+    std::cout << "Heat of a tile that changes every frame " << context.TileHeat[0] << " and one that changed once " << context.TileHeat[1]
+              << std::endl;
+    assert(context.TileHeat[0] > 0.99f && context.TileHeat[1] < 0.01f);
+    // the previous frame is still kept up to date with the changes that were left out
+    assert(std::memcmp(image1.data(), image2.data(), image1.size() * sizeof(SL::Screen_Capture::ImageBGRA)) == 0);
+
+    // once it stops changing it cools down and is reported one more time so nothing is missed
+    SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+    assert(context.Rects.size() == 1 && context.Rects[0] == clock);
+    SL::Screen_Capture::GetDifsAndUpdate(context, reinterpret_cast<unsigned char *>(image1.data()), newimg, options);
+    assert(context.Rects.empty());
+}
+
 int main()
 {
     std::srand(std::time(nullptr));
@@ -346,56 +1137,28 @@ int main()
     std::cout << "Testing recreating" << std::endl;
     createframegrabber();
     std::this_thread::sleep_for(std::chrono::seconds(5));
+    // the capture threads would allocate while TestDiffAllocations counts allocations and take cpu time from the benchmarks
+    framgrabber = nullptr;
 
-    // 4k image
-    int height = 2160;
-    int width = 3840;
-    std::vector<SL::Screen_Capture::ImageBGRA> image1, image2;
-    image1.resize(height * width);
-    for (auto &a : image1) {
-        a.B = static_cast<unsigned short>(std::rand() % 255);
-        a.A = static_cast<unsigned short>(std::rand() % 255);
-        a.G = static_cast<unsigned short>(std::rand() % 255);
-        a.R = static_cast<unsigned short>(std::rand() % 255);
-    }
-    image2.resize(height * width);
-    for (auto &a : image2) {
-        a.B = static_cast<unsigned short>(std::rand() % 255);
-        a.A = static_cast<unsigned short>(std::rand() % 255);
-        a.G = static_cast<unsigned short>(std::rand() % 255);
-        a.R = static_cast<unsigned short>(std::rand() % 255);
-    }
-    long long durationaverage = 0;
-    long long smallestduration = INT_MAX;
-    for (auto i = 0; i < 100; i++) { // run a few times to get an average
-        auto starttime = std::chrono::high_resolution_clock::now();
-        auto difs =
-            SL::Screen_Capture::GetDifs(SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data()),
-                                        SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data()));
-        long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
-        smallestduration = std::min(d, smallestduration);
-        durationaverage += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
-    }
-    durationaverage /= 100;
-    std::cout << "Best Case -- Time to get diffs " << durationaverage << " microseconds" << std::endl;
-    std::cout << "Best Case -- Lowest Time " << smallestduration << " microseconds" << std::endl;
-    memset(image1.data(), 5, image1.size() * sizeof(SL::Screen_Capture::ImageBGRA));
-    memset(image2.data(), 5, image2.size() * sizeof(SL::Screen_Capture::ImageBGRA));
-
-    durationaverage = 0;
-    smallestduration = INT_MAX;
-    for (auto i = 0; i < 100; i++) { // run a few times to get an average
-        auto starttime = std::chrono::high_resolution_clock::now();
-        auto difs =
-            SL::Screen_Capture::GetDifs(SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image1.data()),
-                                        SL::Screen_Capture::CreateImage(SL::Screen_Capture::ImageRect(0, 0, width, height), 0, image2.data()));
-        long long d = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
-        smallestduration = std::min(d, smallestduration);
-        durationaverage += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - starttime).count();
-    }
-    durationaverage /= 100;
-    std::cout << "Worst Case -- Time to get diffs " << durationaverage << " microseconds" << std::endl;
-    std::cout << "Worst Case -- Lowest Time " << smallestduration << " microseconds" << std::endl;
+    BenchmarkGetDifs("1080p", 1920, 1080);
+    BenchmarkGetDifs("4k", 3840, 2160);
+    BenchmarkGetDifs("8k", 7680, 4320);
+    BenchmarkGetDifsThreads("8k", 7680, 4320);
+    BenchmarkRectMerging("4k", 3840, 2160, 40, 32, 64);
+    BenchmarkRectMerging("4k noise", 3840, 2160, 4000, 1, 16);
+    BenchmarkCheckerboard("4k", 3840, 2160, 16);
+    TestDiffAllocations(1920, 1080);
+    TestDiffThreads(1921, 1079);
+    TestAlphaIgnored(1921, 1080);
+    TestMoveDetection(1920, 1080);
+    TestHeatMap(1920, 1080);
+    TestHeatWithMoves(1920, 1080);
+    TestDiffThreshold(1921, 1080);
+    TestDiffSampling(1920, 1080);
+    TestTiledReference(1921, 1079);
+    TestDiffDamage(1920, 1080);
+    BenchmarkReferenceLayout("1080p", 1920, 1080);
+    BenchmarkReferenceLayout("4k", 3840, 2160);
 
     return 0;
 }
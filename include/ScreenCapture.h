@@ -1,6 +1,7 @@
 #pragma once
 #include <assert.h>
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <memory>
@@ -54,6 +55,78 @@ namespace Screen_Capture {
         float Scaling = 1.0f;
     };
 
+    // How the previous frame is remembered in order to find what changed for onFrameChanged
+    enum class DiffReference {
+        // a full copy of the previous frame, changes are exact. This is the default
+        Pixels,
+        // a 64 bit hash per tile, which only needs a few KB per monitor. A hash collision could hide a change until the tile changes again
+        TileHashes,
+        // tile hashes plus a full copy of the previous frame that tiles with an unchanged hash are checked against, so changes are exact again
+        VerifiedTileHashes,
+        // the same as Pixels, but the copy is kept one tile after another so each tile of it is read in one run. Moves are not looked for
+        TiledPixels
+    };
+
+    // The kinds of moves looked for before finding the changes in a frame, see ICaptureConfiguration::setDiffMoveDetection
+    enum class DiffMoves { None, Vertical, Horizontal, Both };
+
+    struct SC_LITE_EXTERN ImageRect {
+        ImageRect() : ImageRect(0, 0, 0, 0) {}
+        ImageRect(int l, int t, int r, int b) : left(l), top(t), right(r), bottom(b) {}
+        int left;
+        int top;
+        int right;
+        int bottom;
+        bool Contains(const ImageRect &a) const { return left <= a.left && right >= a.right && top <= a.top && bottom >= a.bottom; }
+    };
+    // A part of the previous frame that moved, like a scrolled page. The pixels that were in Source are now DeltaX, DeltaY pixels away
+    struct SC_LITE_EXTERN MoveRect {
+        ImageRect Source;
+        int DeltaX = 0;
+        int DeltaY = 0;
+    };
+
+    // One bit per tile of a frame that is set when anything in the tile changed, see ICaptureConfiguration::setDiffTileSize. The tiles in the
+    // last column and row are smaller when the frame is not a multiple of the tile size
+    struct SC_LITE_EXTERN DirtyTiles {
+        int TileWidth = 0;
+        int TileHeight = 0;
+        int Columns = 0;
+        int Rows = 0;
+        // every row of tiles starts on a new word, the tile at row, column is bit column % 64 of Words[row * WordsPerRow + column / 64]
+        const uint64_t *Words = nullptr;
+        size_t WordsPerRow = 0;
+        bool isDirty(int row, int column) const { return (Words[row * WordsPerRow + column / 64] >> (column % 64)) & 1; }
+    };
+    // The parts of a frame that changed, passed to onFrameDirtyRegions. The rects are only valid for the duration of the callback
+    struct SC_LITE_EXTERN DirtyRegions {
+        // the rects that changed since the previous frame in frame coordinates. The first frame is reported as one rect covering all of it
+        const ImageRect *Rects = nullptr;
+        size_t Count = 0;
+        // increases by one for every frame captured from this monitor or window, including frames where nothing changed. It starts again from 0
+        // when capturing is restarted, which always reports the whole frame
+        uint64_t FrameSequence = 0;
+        // the tiles the rects were built from, every tile is dirty on the first frame
+        DirtyTiles Tiles;
+        // the parts of the previous frame that moved, see ICaptureConfiguration::setDiffMoveDetection. To rebuild the frame, apply the moves to the
+        // previous frame in order and then copy in the changed rects, which only cover what the moves did not
+        const MoveRect *Moves = nullptr;
+        size_t MoveCount = 0;
+        const ImageRect *begin() const { return Rects; }
+        const ImageRect *end() const { return Rects + Count; }
+    };
+    // How often each tile of a monitor or window has been changing, see ICaptureConfiguration::setDiffHeatMap. The tiles are laid out like
+    // DirtyTiles
+    struct SC_LITE_EXTERN TileHeatMap {
+        int TileWidth = 0;
+        int TileHeight = 0;
+        int Columns = 0;
+        int Rows = 0;
+        // one value per tile, row by row. It goes from 0 for a tile that never changes up to 1 for a tile that changes every frame
+        std::vector<float> Heat;
+        float heat(int row, int column) const { return Heat[row * Columns + column]; }
+    };
+
     struct Image;
     struct ImageBGRA {
         unsigned char B, G, R, A;
@@ -145,10 +218,22 @@ namespace Screen_Capture {
 
     typedef std::function<void(const SL::Screen_Capture::Image &img, const Window &window)> WindowCaptureCallback;
     typedef std::function<void(const SL::Screen_Capture::Image &img, const Monitor &monitor)> ScreenCaptureCallback;
+    typedef std::function<void(const SL::Screen_Capture::Image &img, const DirtyRegions &regions, const Window &window)> WindowDirtyRegionsCallback;
+    typedef std::function<void(const SL::Screen_Capture::Image &img, const DirtyRegions &regions, const Monitor &monitor)>
+        ScreenDirtyRegionsCallback;
     typedef std::function<void(const SL::Screen_Capture::Image *img, const MousePoint &mousepoint)> MouseCallback;
     typedef std::function<std::vector<Monitor>()> MonitorCallback;
     typedef std::function<std::vector<Window>()> WindowCallback;
 
+    // the onFrameDirtyRegions callback that goes with a capture callback
+    template <typename CAPTURECALLBACK> struct DirtyRegionsCallback;
+    template <> struct DirtyRegionsCallback<ScreenCaptureCallback> {
+        typedef ScreenDirtyRegionsCallback type;
+    };
+    template <> struct DirtyRegionsCallback<WindowCaptureCallback> {
+        typedef WindowDirtyRegionsCallback type;
+    };
+
     class SC_LITE_EXTERN IScreenCaptureManager {
       public:
         virtual ~IScreenCaptureManager() {}
@@ -173,6 +258,10 @@ namespace Screen_Capture {
         virtual bool isPaused() const = 0;
         // Will resume all capturing if paused, otherwise has no effect
         virtual void resume() = 0;
+        // Copies the latest heat map of a monitor or window into heatmap, see ICaptureConfiguration::setDiffHeatMap. Returns false if heat maps are
+        // not enabled or no changes have been looked for in that monitor or window yet
+        virtual bool getTileHeatMap(const Monitor &monitor, TileHeatMap &heatmap) const = 0;
+        virtual bool getTileHeatMap(const Window &window, TileHeatMap &heatmap) const = 0;
     };
 
     template <typename CAPTURECALLBACK> class ICaptureConfiguration {
@@ -182,8 +271,48 @@ namespace Screen_Capture {
         virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> onNewFrame(const CAPTURECALLBACK &cb) = 0;
         // When a change in a frame is detected, the callback is invoked
         virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> onFrameChanged(const CAPTURECALLBACK &cb) = 0;
+        // When a change in a frame is detected, the callback is invoked once with the whole frame and every rect that changed in it. The changes
+        // are found the same way as for onFrameChanged and both can be used at the same time
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>>
+        onFrameDirtyRegions(const typename DirtyRegionsCallback<CAPTURECALLBACK>::type &cb) = 0;
         // When a mouse image changes or the mouse changes position, the callback is invoked.
         virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> onMouseChanged(const MouseCallback &cb) = 0;
+        // The size of the tiles used to find changes for onFrameChanged, the default is 256x256. Smaller tiles produce tighter changed regions at
+        // the cost of more work per frame
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffTileSize(int width, int height) = 0;
+        // The number of threads used to find the changes in each frame, the default is 1. The threads are shared by everything being captured
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffThreads(int threads) = 0;
+        // How the previous frame is remembered when looking for changes, see DiffReference. The default is DiffReference::Pixels
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffReference(DiffReference reference) = 0;
+        // When enabled, each changed tile passed to onFrameChanged is shrunk to the bounding box of the pixels that changed in it. The default is
+        // disabled. This has no effect with DiffReference::TileHashes since the previous pixels are not kept
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffTightRects(bool enabled) = 0;
+        // Ignores changes where no color of a pixel changed by more than threshold (0 to 255), like the noise from font smoothing or dithered
+        // video. The default of 0 finds every change. The previous frame is only updated where changes are found, so slow fades are still
+        // reported once they add up. This only works with DiffReference::Pixels and DiffReference::TiledPixels
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffThreshold(int threshold) = 0;
+        // Merges nearby changed rects so onFrameChanged is called fewer times. Rects are merged while the merged rect is at most maxoverdraw times
+        // the area of the rects it replaces, then the cheapest ones are merged until there are at most maxrects (0 for no limit). The default of
+        // 0, 1.0 only merges rects that fit together exactly
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffRectMerging(int maxrects, float maxoverdraw) = 0;
+        // Looks for parts of the frame that scrolled and reports them as moves to onFrameDirtyRegions, so the moved pixels are not reported as
+        // changed. Moves are found one column of tiles (or row of tiles for horizontal moves) at a time. The default is DiffMoves::None. This only
+        // works with DiffReference::Pixels and is not used while onFrameChanged is set, since it has no way to report a move. While a tile left
+        // out by setDiffHeatMap has changes that were not reported, no moves are looked for
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffMoveDetection(DiffMoves moves) = 0;
+        // Checks every rowstride-th row before looking for changes and skips the rest of the work when none of them changed, which is most frames
+        // on a screen that is not being used. The rows checked move along by one every frame, so a change that is missed is found within
+        // rowstride frames. At most fullscaninterval frames in a row are skipped before all of the frame is looked at anyway, 0 for no limit. A
+        // rowstride of 0, the default, looks at every frame in full
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffSampling(int rowstride, int fullscaninterval) = 0;
+        // Keeps track of how often each tile changes, which IScreenCaptureManager::getTileHeatMap returns. Every frame the heat of each tile is
+        // multiplied by decay (between 0 and 1, 0 turns heat maps off) and tiles that changed add 1 - decay. Tiles hotter than maxheat are left out
+        // of the changes until they cool down again, then they are reported once in full. A maxheat of 1 or more never leaves anything out
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setDiffHeatMap(float decay, float maxheat) = 0;
+        // Grabs the whole screen once per frame and gives each monitor its part of that grab, instead of grabbing each monitor on its own. All
+        // monitors then show the same instant and the screen is only read once per frame. The default is disabled. Only used for monitors on
+        // linux, where it also stops XDamage from being used. When built with SCREEN_CAPTURE_XCB those monitors are captured with Xlib instead
+        virtual std::shared_ptr<ICaptureConfiguration<CAPTURECALLBACK>> setSingleGrab(bool enabled) = 0;
         // start capturing
         virtual std::shared_ptr<IScreenCaptureManager> start_capturing() = 0;
     };
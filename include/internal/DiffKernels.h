@@ -0,0 +1,37 @@
+#pragma once
+#include "ScreenCapture.h"
+#include <cstddef>
+#include <cstdint>
+
+// this is INTERNAL DO NOT USE!
+namespace SL {
+namespace Screen_Capture {
+    // all of the kernels ignore the alpha byte of each pixel, it might contain garbage
+    // returns true if any of the npixels pixels starting at a and b are different
+    typedef bool (*PixelCompareFunction)(const ImageBGRA *a, const ImageBGRA *b, size_t npixels);
+    // continues the 64 bit hash seed over npixels pixels, so a tile can be hashed one row at a time
+    typedef uint64_t (*PixelHashFunction)(uint64_t seed, const ImageBGRA *a, size_t npixels);
+    // returns true if any of the npixels pixels are different, first and last are set to the index of the first and last pixel that differ
+    typedef bool (*PixelFindChangesFunction)(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, size_t &first, size_t &last);
+    // same as PixelCompareFunction and PixelFindChangesFunction, but a pixel is only different when one of its colors differs by more than threshold
+    typedef bool (*PixelCompareThresholdFunction)(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, unsigned char threshold);
+    typedef bool (*PixelFindChangesThresholdFunction)(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, unsigned char threshold, size_t &first,
+                                                      size_t &last);
+
+    enum class DiffInstructionSet { Scalar, SSE2, AVX2 };
+
+    struct DiffKernels {
+        DiffInstructionSet InstructionSet = DiffInstructionSet::Scalar;
+        PixelCompareFunction Compare = nullptr;
+        PixelHashFunction Hash = nullptr;
+        PixelFindChangesFunction FindChanges = nullptr;
+        PixelCompareThresholdFunction CompareThreshold = nullptr;
+        PixelFindChangesThresholdFunction FindChangesThreshold = nullptr;
+    };
+
+    // the best kernels for the cpu the library is running on. These are selected once, the first time this is called
+    SC_LITE_EXTERN const DiffKernels &GetDiffKernels();
+    // the kernels for a specific instruction set, falls back to the next best set if the cpu does not support it
+    SC_LITE_EXTERN DiffKernels GetDiffKernels(DiffInstructionSet instructionset);
+} // namespace Screen_Capture
+} // namespace SL
@@ -1,20 +1,14 @@
 #pragma once
 #include "ScreenCapture.h"
 #include <atomic>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 
 // this is INTERNAL DO NOT USE!
 namespace SL {
 namespace Screen_Capture {
-    struct ImageRect {
-        ImageRect() : ImageRect(0, 0, 0, 0) {}
-        ImageRect(int l, int t, int r, int b) : left(l), top(t), right(r), bottom(b) {}
-        int left;
-        int top;
-        int right;
-        int bottom;
-        bool Contains(const ImageRect &a) const { return left <= a.left && right >= a.right && top <= a.top && bottom >= a.bottom; }
-    };
     struct Image {
         ImageRect Bounds;
         int BytesToNextRow = 0;
@@ -31,13 +25,108 @@ namespace Screen_Capture {
     int Width(const ImageRect &rect);
     const ImageRect &Rect(const Image &img);
 
+    struct DiffOptions {
+        // the frame is split into tiles of this size, a change anywhere in a tile marks the whole tile as changed
+        int TileWidth = 256;
+        int TileHeight = 256;
+        // the number of threads a frame is split across when looking for changes, only used when a WorkerPool is passed to GetDifs
+        int Threads = 1;
+        DiffReference Reference = DiffReference::Pixels;
+        // shrink each changed tile down to the bounding box of the pixels that changed in it. Needs the pixels of the previous frame, so it has no
+        // effect with DiffReference::TileHashes
+        bool TightRects = false;
+        // a pixel only counts as changed when one of its colors changed by more than this, 0 finds every change. Only used with
+        // DiffReference::Pixels and DiffReference::TiledPixels, tile hashes change with any change
+        unsigned char Threshold = 0;
+        // rects keep being merged while the merged rect is at most MaxOverdraw times the area of the changed rects it covers. 1 only merges rects
+        // that fit together exactly
+        float MaxOverdraw = 1.0f;
+        // the most rects reported for a frame, 0 for no limit. The pairs that add the fewest unchanged pixels are merged until the limit is met
+        int MaxRects = 0;
+        // moves are looked for and applied to the previous frame before finding the changes, only by GetDifsAndUpdate
+        DiffMoves Moves = DiffMoves::None;
+        // when set, every SampleRows-th row is checked first and the full diff is skipped when none of them changed. The rows checked move
+        // along by one every frame, with only tile hashes a checksum of the rows is compared instead. 0 always does the full diff. Not
+        // used for frames that come with damage, see DiffContext::Damage
+        int SampleRows = 0;
+        // the most frames in a row that are skipped by SampleRows before a full diff is done anyway, 0 for no limit
+        int FullScanInterval = 0;
+        // every frame the heat of each tile is multiplied by HeatDecay and tiles that changed add 1 - HeatDecay, 0 does not keep track of heat
+        float HeatDecay = 0.0f;
+        // tiles hotter than this are left out of the changes until they cool down, 1 or more never leaves anything out
+        float MaxHeat = 1.0f;
+    };
+    class WorkerPool;
+
+    // what a frame processor keeps from one diff to the next. The vectors are reused for every frame, so once they have grown to fit the frame
+    // finding the changes does not allocate
+    struct DiffContext {
+        // one hash per tile of the previous frame when DiffOptions::Reference uses tile hashes
+        std::vector<uint64_t> TileHashes;
+        // the changed tiles of the last frame, see DirtyTiles
+        std::vector<uint64_t> ChangedTiles;
+        // the rects that changed in the last frame
+        std::vector<ImageRect> Rects;
+        // the moves found in the last frame, the rects are relative to the previous frame after these were applied
+        std::vector<MoveRect> Moves;
+        // the hash of each row in each column of tiles and of each column in each row of tiles of the previous frame, used to find moves
+        std::vector<uint64_t> RowHashes;
+        std::vector<uint64_t> ColumnHashes;
+        // the heat of each tile, see DiffOptions::HeatDecay
+        std::vector<float> TileHeat;
+        // one byte per tile, set while a tile has changes that were left out for being too hot
+        std::vector<unsigned char> HotTiles;
+        // see DiffOptions::SampleRows. Which rows to sample next, the frames skipped since the last full diff and, when only tile hashes are
+        // kept, the checksum of each set of rows from the last time they were sampled
+        size_t SamplePhase = 0;
+        int SkippedFrames = 0;
+        std::vector<uint64_t> SampleChecksums;
+        std::vector<unsigned char> HasSampleChecksums;
+        // the parts of the frame that could have changed since the previous one, when the platform knows (like XDamage on linux). When HasDamage
+        // is set the next diff only looks at the tiles the rects touch, an empty Damage means nothing changed. Both are reset by every diff
+        std::vector<ImageRect> Damage;
+        bool HasDamage = false;
+        // scratch space for a single diff
+        std::vector<uint64_t> NewTileHashes;
+        std::vector<ImageRect> TileBounds;
+        std::vector<uint64_t> DamagedTiles;
+        std::vector<ImageRect> MergedRects;
+        std::vector<size_t> MergeColumns;
+        std::vector<size_t> MergeBest;
+        std::vector<double> MergeCost;
+        std::vector<int64_t> MergeArea;
+        std::vector<size_t> MergePrev;
+        std::vector<size_t> MergeNext;
+        std::vector<std::pair<double, size_t>> MergeHeap;
+        std::vector<uint64_t> NewRowHashes;
+        std::vector<uint64_t> NewColumnHashes;
+        std::vector<std::pair<uint64_t, size_t>> SortedHashes;
+        std::vector<int> MoveVotes;
+    };
+
+    // the latest heat map of everything being captured, written by the capture threads and read by IScreenCaptureManager::getTileHeatMap
+    struct TileHeatMaps {
+        std::mutex Lock;
+        std::unordered_map<size_t, TileHeatMap> Maps;
+    };
+    inline size_t HeatMapKey(const Monitor &monitor) { return static_cast<size_t>(monitor.Id); }
+    inline size_t HeatMapKey(const Window &window) { return window.Handle; }
+
     template <typename F, typename M, typename W> struct CaptureData {
         std::shared_ptr<Timer> FrameTimer;
         F OnNewFrame;
         F OnFrameChanged;
+        typename DirtyRegionsCallback<F>::type OnFrameDirtyRegions;
         std::shared_ptr<Timer> MouseTimer;
         M OnMouseChanged;
         W getThingsToWatch;
+        DiffOptions Diff;
+        // shared by all capture threads, only created when Diff.Threads is greater than one
+        std::shared_ptr<WorkerPool> DiffWorkers;
+        // only created when Diff.HeatDecay is set
+        std::shared_ptr<TileHeatMaps> HeatMaps;
+        // see ICaptureConfiguration::setSingleGrab
+        bool SingleGrab = false;
     };
     struct CommonData {
         // Used to indicate abnormal error condition
@@ -59,20 +148,57 @@ namespace Screen_Capture {
     class BaseFrameProcessor {
       public:
         std::shared_ptr<Thread_Data> Data;
+        // the previous frame, only allocated when it is needed to find changes
         std::unique_ptr<unsigned char[]> ImageBuffer;
         int ImageBufferSize = 0;
+        DiffContext DiffState;
         bool FirstRun = true;
+        // the number of frames processed so far, see DirtyRegions::FrameSequence
+        uint64_t FrameSequence = 0;
     };
 
     enum DUPL_RETURN { DUPL_RETURN_SUCCESS = 0, DUPL_RETURN_ERROR_EXPECTED = 1, DUPL_RETURN_ERROR_UNEXPECTED = 2 };
     Monitor CreateMonitor(int index, int id, int h, int w, int ox, int oy, const std::string &n, float scale);
     Monitor CreateMonitor(int index, int id, int adapter, int h, int w, int ox, int oy, const std::string &n, float scale);
     SC_LITE_EXTERN bool isMonitorInsideBounds(const std::vector<Monitor> &monitors, const Monitor &monitor);
+    // changes whenever the monitors might have changed since the last call, so GetMonitors only has to be called when it does. Platforms that
+    // cannot tell return a new value every call
+    uint64_t MonitorsGeneration();
     SC_LITE_EXTERN Image CreateImage(const ImageRect &imgrect, int rowpadding, const ImageBGRA *data);
     // this function will copy data from the src into the dst. The only requirement is that src must not be larger than dst, but it can be smaller
     // void Copy(const Image& dst, const Image& src);
 
-    SC_LITE_EXTERN std::vector<ImageRect> GetDifs(const Image &oldimg, const Image &newimg);
+    SC_LITE_EXTERN std::vector<ImageRect> GetDifs(const Image &oldimg, const Image &newimg, const DiffOptions &options = DiffOptions(),
+                                                  WorkerPool *workers = nullptr);
+    // same as GetDifs, but everything is kept in context. The rects returned are context.Rects and the changed tiles are in context.ChangedTiles
+    SC_LITE_EXTERN const std::vector<ImageRect> &GetDifs(DiffContext &context, const Image &oldimg, const Image &newimg,
+                                                         const DiffOptions &options = DiffOptions(), WorkerPool *workers = nullptr);
+    // same as GetDifs, but the changed tiles are also copied from newimg into oldimg, which must be a tightly packed image the size of newimg. This
+    // makes oldimg equal to newimg while only reading each unchanged byte once and only writing the bytes that changed. When options.Moves is set
+    // the moves found are put in context.Moves and applied to oldimg first. With DiffReference::TiledPixels oldimg is kept one tile after another
+    // instead, see CopyReference
+    SC_LITE_EXTERN const std::vector<ImageRect> &GetDifsAndUpdate(DiffContext &context, unsigned char *oldimg, const Image &newimg,
+                                                                  const DiffOptions &options = DiffOptions(), WorkerPool *workers = nullptr);
+    // same as GetDifsAndUpdate, but the previous frame is remembered as context.TileHashes. oldimg is optional, when it is set tiles whose hash did
+    // not change are compared against it so no change can be missed because of a hash collision
+    SC_LITE_EXTERN const std::vector<ImageRect> &GetHashDifsAndUpdate(DiffContext &context, unsigned char *oldimg, const Image &newimg,
+                                                                      const DiffOptions &options = DiffOptions(), WorkerPool *workers = nullptr);
+    // copies img into reference, laid out the way options.Reference keeps the previous frame
+    SC_LITE_EXTERN void CopyReference(unsigned char *reference, const Image &img, const DiffOptions &options);
+    // reports every tile of rect as changed in context, as if the previous frame had nothing in common with this one
+    SC_LITE_EXTERN void AllTilesChanged(DiffContext &context, const ImageRect &rect, const DiffOptions &options);
+    inline int TileColumns(const ImageRect &rect, const DiffOptions &options) { return (Width(rect) + options.TileWidth - 1) / options.TileWidth; }
+    inline int TileRows(const ImageRect &rect, const DiffOptions &options) { return (Height(rect) + options.TileHeight - 1) / options.TileHeight; }
+    inline size_t TileCount(const ImageRect &rect, const DiffOptions &options)
+    {
+        return static_cast<size_t>(TileRows(rect, options)) * static_cast<size_t>(TileColumns(rect, options));
+    }
+    template <class F> bool WantsDifs(const F &data) { return data.OnFrameChanged || data.OnFrameDirtyRegions; }
+    inline bool NeedsImageBuffer(const DiffOptions &options) { return options.Reference != DiffReference::TileHashes; }
+    inline bool UsesTileHashes(const DiffOptions &options)
+    {
+        return options.Reference == DiffReference::TileHashes || options.Reference == DiffReference::VerifiedTileHashes;
+    }
     template <class F, class T, class C>
     void ProcessCapture(const F &data, T &base, const C &mointor, const unsigned char *startsrc, int srcrowstride)
     {
@@ -89,21 +215,41 @@ namespace Screen_Capture {
             wholeimg.isContiguous = dstrowstride == srcrowstride;
             data.OnNewFrame(wholeimg, mointor);
         }
-        if (data.OnFrameChanged) { // difs are needed!
+        if (WantsDifs(data)) { // difs are needed!
+            const auto usehashes = UsesTileHashes(data.Diff);
+            auto &context = base.DiffState;
+            auto wholeimg = CreateImage(imageract, srcrowstride, startimgsrc);
+            wholeimg.isContiguous = dstrowstride == srcrowstride;
             if (base.FirstRun) {
                 // first time through, just send the whole image
-                auto wholeimg = CreateImage(imageract, srcrowstride, startimgsrc);
-                wholeimg.isContiguous = dstrowstride == srcrowstride;
-                data.OnFrameChanged(wholeimg, mointor);
+                context.HasDamage = false;
+                if (data.OnFrameChanged) {
+                    data.OnFrameChanged(wholeimg, mointor);
+                }
                 base.FirstRun = false;
+
+                if (base.ImageBuffer) { // there is no copy of the frame when only tile hashes are kept
+                    CopyReference(base.ImageBuffer.get(), CreateImage(imageract, srcrowstride - dstrowstride, startimgsrc), data.Diff);
+                }
+                if (usehashes) {
+                    // the frame was copied above, this only fills in the hashes
+                    GetHashDifsAndUpdate(context, nullptr, CreateImage(imageract, srcrowstride - dstrowstride, startimgsrc), data.Diff,
+                                         data.DiffWorkers.get());
+                }
+                AllTilesChanged(context, imageract, data.Diff);
             }
             else {
-                // user wants difs, lets do it!
+                // user wants difs, lets do it! This also brings the old frame up to date
                 auto newimg = CreateImage(imageract, srcrowstride - dstrowstride, startimgsrc);
-                auto oldimg = CreateImage(imageract, 0, reinterpret_cast<const ImageBGRA *>(base.ImageBuffer.get()));
-                auto imgdifs = GetDifs(oldimg, newimg);
+                auto options = data.Diff;
+                if (data.OnFrameChanged) {
+                    options.Moves = DiffMoves::None; // there is no way to tell onFrameChanged about a move
+                }
+                const auto &imgdifs = usehashes ? GetHashDifsAndUpdate(context, base.ImageBuffer.get(), newimg, options, data.DiffWorkers.get())
+                                                : GetDifsAndUpdate(context, base.ImageBuffer.get(), newimg, options, data.DiffWorkers.get());
 
-                for (auto &r : imgdifs) {
+                for (size_t i = 0; data.OnFrameChanged && i < imgdifs.size(); i++) {
+                    auto &r = imgdifs[i];
                     auto leftoffset = r.left * sizeofimgbgra;
                     auto thisstartsrc = startsrc + leftoffset + (r.top * srcrowstride);
 
@@ -112,16 +258,32 @@ namespace Screen_Capture {
                     data.OnFrameChanged(difimg, mointor);
                 }
             }
-            auto startdst = base.ImageBuffer.get();
-            if (dstrowstride == srcrowstride) { // no need for multiple calls, there is no padding here
-                memcpy(startdst, startsrc, dstrowstride * Height(mointor));
+            if (data.HeatMaps && !context.TileHeat.empty()) {
+                std::lock_guard<std::mutex> lock(data.HeatMaps->Lock);
+                auto &heatmap = data.HeatMaps->Maps[HeatMapKey(mointor)];
+                heatmap.TileWidth = data.Diff.TileWidth;
+                heatmap.TileHeight = data.Diff.TileHeight;
+                heatmap.Columns = TileColumns(imageract, data.Diff);
+                heatmap.Rows = TileRows(imageract, data.Diff);
+                heatmap.Heat.assign(context.TileHeat.begin(), context.TileHeat.end());
             }
-            else {
-                for (auto i = 0; i < Height(mointor); i++) {
-                    memcpy(startdst + (i * dstrowstride), startsrc + (i * srcrowstride), dstrowstride);
-                }
+            if (data.OnFrameDirtyRegions && (!context.Rects.empty() || !context.Moves.empty())) {
+                DirtyRegions regions;
+                regions.Rects = context.Rects.data();
+                regions.Count = context.Rects.size();
+                regions.FrameSequence = base.FrameSequence;
+                regions.Tiles.TileWidth = data.Diff.TileWidth;
+                regions.Tiles.TileHeight = data.Diff.TileHeight;
+                regions.Tiles.Columns = TileColumns(imageract, data.Diff);
+                regions.Tiles.Rows = TileRows(imageract, data.Diff);
+                regions.Tiles.Words = context.ChangedTiles.data();
+                regions.Tiles.WordsPerRow = (regions.Tiles.Columns + 63) / 64;
+                regions.Moves = context.Moves.data();
+                regions.MoveCount = context.Moves.size();
+                data.OnFrameDirtyRegions(wholeimg, regions, mointor);
             }
         }
+        base.FrameSequence += 1;
     }
 } // namespace Screen_Capture
 } // namespace SL
@@ -85,11 +85,15 @@ namespace Screen_Capture {
     {
         T frameprocessor;   
         frameprocessor.ImageBufferSize = Width(monitor) * Height(monitor) * sizeof(ImageBGRA);
-        if (data->ScreenCaptureData.OnFrameChanged) { // only need the old buffer if difs are needed. If no dif is needed, then the
-                                                      // image is always new
+        if (WantsDifs(data->ScreenCaptureData) &&
+            NeedsImageBuffer(data->ScreenCaptureData.Diff)) { // only need the old buffer if difs are needed. If no dif is needed, then the
+                                                              // image is always new
             frameprocessor.ImageBuffer = std::make_unique<unsigned char[]>(frameprocessor.ImageBufferSize);
         }
+        auto generation = MonitorsGeneration();
         auto startmonitors = GetMonitors();
+        auto monitors = startmonitors;
+        auto changed = !isMonitorInsideBounds(monitors, monitor);
         auto ret = frameprocessor.Init(data, monitor);
         if (ret != DUPL_RETURN_SUCCESS) {
             return false;
@@ -101,8 +105,14 @@ namespace Screen_Capture {
             frameprocessor.Resume();
             auto timer = std::atomic_load(&data->ScreenCaptureData.FrameTimer);
             timer->start();
-            auto monitors = GetMonitors();
-            if (isMonitorInsideBounds(monitors, monitor) && !HasMonitorsChanged(startmonitors, monitors)) {
+            // only ask for the monitors again when they might have changed
+            auto nowgeneration = MonitorsGeneration();
+            if (nowgeneration != generation) {
+                generation = nowgeneration;
+                monitors = GetMonitors();
+                changed = !isMonitorInsideBounds(monitors, monitor) || HasMonitorsChanged(startmonitors, monitors);
+            }
+            if (!changed) {
                 ret = frameprocessor.ProcessFrame(monitors[Index(monitor)]);
             }
             else {
@@ -135,8 +145,9 @@ namespace Screen_Capture {
     {
         T frameprocessor;
         frameprocessor.ImageBufferSize = wnd.Size.x * wnd.Size.y * sizeof(ImageBGRA);
-        if (data->WindowCaptureData.OnFrameChanged) { // only need the old buffer if difs are needed. If no dif is needed, then the
-                                                      // image is always new
+        if (WantsDifs(data->WindowCaptureData) &&
+            NeedsImageBuffer(data->WindowCaptureData.Diff)) { // only need the old buffer if difs are needed. If no dif is needed, then the
+                                                              // image is always new
             frameprocessor.ImageBuffer = std::make_unique<unsigned char[]>(frameprocessor.ImageBufferSize);
         }
         auto ret = frameprocessor.Init(data, wnd);
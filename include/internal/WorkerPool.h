@@ -0,0 +1,56 @@
+#pragma once
+#include "ScreenCapture.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// this is INTERNAL DO NOT USE!
+namespace SL {
+namespace Screen_Capture {
+    // A small pool of threads that can be shared by all of the capture threads. The thread calling Run works on the job as well, so a pool with
+    // N threads runs a job on up to N+1 threads.
+    class SC_LITE_EXTERN WorkerPool {
+        // a job lives on the stack of the thread that called Run, so running one does not allocate
+        struct Job {
+            void (*Work)(const void *context, size_t i) = nullptr;
+            const void *Context = nullptr;
+            size_t Count = 0;
+            std::atomic<size_t> Next{0};
+            std::atomic<size_t> Done{0};
+            // the pool threads working on the job, Run does not return until this is 0. Only changed with Mutex held
+            size_t Workers = 0;
+        };
+
+        std::mutex Mutex;
+        std::condition_variable JobAdded;
+        std::condition_variable JobDone;
+        // only grows to the most jobs that were ever waiting at once
+        std::vector<Job *> Jobs;
+        std::vector<std::thread> Threads;
+        bool Stopping = false;
+
+        void Work(Job &job);
+        void WorkerLoop();
+        void Run(Job &job);
+
+      public:
+        WorkerPool(size_t threads);
+        ~WorkerPool();
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        size_t size() const { return Threads.size(); }
+        // calls work(i) for every i in [0, count) and returns once all of them have completed. work is only referred to, not copied
+        template <class F> void Run(size_t count, const F &work)
+        {
+            Job job;
+            job.Work = [](const void *context, size_t i) { (*static_cast<const F *>(context))(i); };
+            job.Context = &work;
+            job.Count = count;
+            Run(job);
+        }
+    };
+} // namespace Screen_Capture
+} // namespace SL
@@ -0,0 +1,13 @@
+#pragma once
+#include <memory>
+#include <X11/Xlib.h>
+
+namespace SL {
+    namespace Screen_Capture {
+
+        // returns the connection to the X server shared by the frame and mouse processors, GetMonitors and GetWindows, opening it when there is
+        // none. It is closed when the last reference goes away. Xlib is put into thread safe mode before the first connection is opened.
+        // Returns nullptr when the X server cannot be reached
+        std::shared_ptr<Display> GetX11Connection();
+    }
+}
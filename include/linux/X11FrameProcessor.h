@@ -1,20 +1,55 @@
 #pragma once
 #include "internal/SCCommon.h"
+#include "X11Connection.h"
+#include "X11RootGrab.h"
 #include <memory>
+#include <utility>
+#include <vector>
 #include <X11/Xlib.h>
 #include <sys/shm.h>
 #include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xcomposite.h>
 
 namespace SL {
     namespace Screen_Capture {
    
         class X11FrameProcessor: public BaseFrameProcessor {
             
+			std::shared_ptr<Display> Connection;
 			Display* SelectedDisplay=nullptr;
             XID SelectedWindow = 0;
 			XImage* XImage_=nullptr;
 			std::unique_ptr<XShmSegmentInfo> ShmInfo;
             Monitor SelectedMonitor;
+            // only set with ICaptureConfiguration::setSingleGrab, the monitor is then read from a grab shared with the other monitors
+            std::shared_ptr<X11RootGrab> RootGrab;
+            uint64_t RootGrabGeneration = 0;
+            // what was drawn since the last frame, only created when the server has the XDamage extension
+            Damage Damage_ = 0;
+            XserverRegion DamageRegion = 0;
+            int DamageEventBase = 0;
+
+            // the rows that were damaged this frame, top and bottom
+            std::vector<std::pair<int, int>> DamagedRows;
+            // set to grab everything next frame, even when there is damage information. Damage only says what changed since the last grab, so this
+            // stays set until all of XImage_ has been grabbed once
+            bool GrabAll = true;
+
+            // when the server has the composite extension a window is redirected and read from its off-screen pixmap, so it can be captured while
+            // it is covered by other windows. The pixmap is only valid while the window is shown and is named again after that
+            bool Composited = false;
+            Pixmap WindowPixmap = 0;
+            // what XImage_ is created with for a window, so it can be created again when the window is resized
+            Visual* WindowVisual = nullptr;
+            int WindowDepth = 0;
+
+            void CreateWindowImage(int width, int height);
+            void DestroyImage();
+            void ResizeWindow(Window& selectedwindow, int width, int height);
+            void InitDamage(Drawable drawable);
+            bool GetDamage(const ImageRect& bounds);
+            bool GrabImage(Drawable drawable, int x, int y);
             
         public:
             X11FrameProcessor();
@@ -1,5 +1,6 @@
 #pragma once
 #include "internal/SCCommon.h"
+#include "X11Connection.h"
 #include <memory>
 #include <X11/X.h>
 #include <X11/extensions/Xfixes.h>
@@ -8,6 +9,7 @@ namespace SL {
     namespace Screen_Capture {
         
         class X11MouseProcessor: public BaseFrameProcessor {
+            std::shared_ptr<Display> Connection;
             Display* SelectedDisplay=nullptr;
             std::unique_ptr<unsigned char[]> OldImageBuffer;
             XID RootWindow;
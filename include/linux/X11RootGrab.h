@@ -0,0 +1,42 @@
+#pragma once
+#include "X11Connection.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <X11/Xlib.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+
+namespace SL {
+    namespace Screen_Capture {
+
+        // one grab of the whole root window shared by the monitor threads of a capture, see ICaptureConfiguration::setSingleGrab. The root is
+        // only grabbed again once no monitor is still reading the last grab, so threads that ask at about the same time get the same grab
+        class X11RootGrab {
+            std::shared_ptr<Display> Connection;
+            XImage* XImage_ = nullptr;
+            XShmSegmentInfo ShmInfo = {};
+            std::mutex Lock;
+            std::condition_variable Released;
+            uint64_t Generation = 0;
+            int Readers = 0;
+
+        public:
+            X11RootGrab();
+            ~X11RootGrab();
+            bool Init();
+            // waits for a grab newer than generation and sets generation to it. Returns the start of the grab, or nullptr if grabbing failed.
+            // Release must be called once the grab is no longer read
+            const unsigned char* Acquire(uint64_t& generation);
+            void Release();
+            int BytesPerLine() const { return XImage_->bytes_per_line; }
+            // the size of the root window when the grab was created, monitors outside of it cannot be read from the grab
+            int Width() const { return XImage_->width; }
+            int Height() const { return XImage_->height; }
+        };
+
+        // returns the root grab shared by everything with the same owner, creating it when there is none. Returns nullptr if it cannot be created
+        std::shared_ptr<X11RootGrab> GetX11RootGrab(const void* owner);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "internal/SCCommon.h"
+#include "X11Connection.h"
+#include <memory>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+namespace SL {
+    namespace Screen_Capture {
+
+        // captures a monitor with xcb. The grab for the next frame is requested as soon as a frame arrives, so the server copies it while this
+        // frame is diffed and the thread does not wait for a round trip. Frames are up to one frame interval older than with X11FrameProcessor
+        class XCBFrameProcessor: public BaseFrameProcessor {
+
+            struct ShmBuffer {
+                xcb_shm_seg_t Segment = 0;
+                int Id = -1;
+                unsigned char* Data = nullptr;
+            };
+
+            std::shared_ptr<Display> Connection;
+            xcb_connection_t* XCBConnection = nullptr;
+            xcb_window_t Root = 0;
+            Monitor SelectedMonitor;
+            // one buffer is diffed while the server writes the next frame into the other
+            ShmBuffer Buffers[2];
+            int Current = 0;
+            xcb_shm_get_image_cookie_t Pending = {};
+            bool HasPending = false;
+
+            bool CreateBuffer(ShmBuffer& buffer, size_t size);
+            void RequestImage();
+            void DiscardImage();
+
+        public:
+            XCBFrameProcessor();
+            ~XCBFrameProcessor();
+
+            void Pause();
+            void Resume() {}
+            DUPL_RETURN Init(std::shared_ptr<Thread_Data> data, Monitor& monitor);
+            DUPL_RETURN ProcessFrame(const Monitor& currentmonitorinfo);
+        };
+    }
+}
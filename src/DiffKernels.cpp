@@ -0,0 +1,462 @@
+#include "internal/DiffKernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SC_LITE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SC_LITE_TARGET(x) __attribute__((target(x)))
+#else
+#define SC_LITE_TARGET(x)
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace SL {
+namespace Screen_Capture {
+
+    // alpha might contain garbage (see Image), so only the B, G and R bytes of a pixel are compared and hashed
+    static const uint32_t ColorMask = 0x00FFFFFF;
+    static const uint64_t ColorMask2 = 0x00FFFFFF00FFFFFFull;
+
+    static bool PixelsDiffer(const ImageBGRA *a, const ImageBGRA *b)
+    {
+        uint32_t pa, pb;
+        memcpy(&pa, a, sizeof(pa));
+        memcpy(&pb, b, sizeof(pb));
+        return ((pa ^ pb) & ColorMask) != 0;
+    }
+
+    static bool CompareScalar(const ImageBGRA *a, const ImageBGRA *b, size_t npixels)
+    {
+        size_t i = 0;
+        for (; i + 2 <= npixels; i += 2) { // 2 pixels at a time
+            uint64_t pa, pb;
+            memcpy(&pa, a + i, sizeof(pa));
+            memcpy(&pb, b + i, sizeof(pb));
+            if ((pa ^ pb) & ColorMask2) {
+                return true;
+            }
+        }
+        return i < npixels && PixelsDiffer(a + i, b + i);
+    }
+
+    // index of the lowest and highest set bit, mask must not be zero
+    static unsigned int LowestBit(unsigned int mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+    static unsigned int HighestBit(unsigned int mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse(&index, mask);
+        return index;
+#else
+        return 31 - __builtin_clz(mask);
+#endif
+    }
+
+    // scans back from the end for the last changed pixel, first is known to be different
+    static size_t FindLastChangeScalar(const ImageBGRA *a, const ImageBGRA *b, size_t end, size_t first)
+    {
+        while (end > first + 1 && !PixelsDiffer(a + end - 1, b + end - 1)) {
+            end--;
+        }
+        return end - 1;
+    }
+
+    static bool FindChangesScalar(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, size_t &first, size_t &last)
+    {
+        for (size_t i = 0; i < npixels; i++) {
+            if (PixelsDiffer(a + i, b + i)) {
+                first = i;
+                last = FindLastChangeScalar(a, b, npixels, first);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool PixelsDiffer(const ImageBGRA *a, const ImageBGRA *b, int threshold)
+    {
+        return std::abs(a->B - b->B) > threshold || std::abs(a->G - b->G) > threshold || std::abs(a->R - b->R) > threshold;
+    }
+
+    static bool CompareThresholdScalar(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, unsigned char threshold)
+    {
+        for (size_t i = 0; i < npixels; i++) {
+            if (PixelsDiffer(a + i, b + i, threshold)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // compare finds out whether anything changed at full speed, only a row that did change is walked a pixel at a time from both ends
+    template <PixelCompareThresholdFunction compare>
+    static bool FindChangesThreshold(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, unsigned char threshold, size_t &first, size_t &last)
+    {
+        if (!compare(a, b, npixels, threshold)) {
+            return false;
+        }
+        first = 0;
+        while (!PixelsDiffer(a + first, b + first, threshold)) {
+            first++;
+        }
+        last = npixels - 1;
+        while (!PixelsDiffer(a + last, b + last, threshold)) {
+            last--;
+        }
+        return true;
+    }
+
+    static uint64_t HashScalar(uint64_t seed, const ImageBGRA *a, size_t npixels)
+    {
+        auto p = reinterpret_cast<const unsigned char *>(a);
+        const auto end = p + npixels * sizeof(ImageBGRA);
+        auto h = seed;
+        for (; p + sizeof(uint64_t) <= end; p += sizeof(uint64_t)) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            h = (h ^ (v & ColorMask2)) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 32;
+        }
+        if (p < end) { // odd number of pixels
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            h = (h ^ (v & ColorMask)) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+#if defined(SC_LITE_X86)
+
+    SC_LITE_TARGET("sse2") static bool CompareSSE2(const ImageBGRA *a, const ImageBGRA *b, size_t npixels)
+    {
+        auto pa = reinterpret_cast<const __m128i *>(a);
+        auto pb = reinterpret_cast<const __m128i *>(b);
+        const auto colormask = _mm_set1_epi32(ColorMask);
+        size_t i = 0;
+        // 16 pixels per iteration, the xors are or'ed together so there is only one branch and one mask for 64 bytes
+        for (; i + 16 <= npixels; i += 16, pa += 4, pb += 4) {
+            auto x0 = _mm_xor_si128(_mm_loadu_si128(pa), _mm_loadu_si128(pb));
+            auto x1 = _mm_xor_si128(_mm_loadu_si128(pa + 1), _mm_loadu_si128(pb + 1));
+            auto x2 = _mm_xor_si128(_mm_loadu_si128(pa + 2), _mm_loadu_si128(pb + 2));
+            auto x3 = _mm_xor_si128(_mm_loadu_si128(pa + 3), _mm_loadu_si128(pb + 3));
+            auto x = _mm_and_si128(_mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3)), colormask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) {
+                return true;
+            }
+        }
+        for (; i + 4 <= npixels; i += 4, pa++, pb++) {
+            auto x = _mm_and_si128(_mm_xor_si128(_mm_loadu_si128(pa), _mm_loadu_si128(pb)), colormask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) {
+                return true;
+            }
+        }
+        return CompareScalar(a + i, b + i, npixels - i);
+    }
+
+    // the threshold of every color byte, the alpha byte can never go over 255 so it is ignored for free
+    static uint32_t ThresholdBytes(unsigned char threshold) { return 0xFF000000u | (threshold * 0x00010101u); }
+
+    // the amount each byte of a and b differs by over the threshold, saturated to 0 when it is not over
+    SC_LITE_TARGET("sse2") static __m128i OverThresholdSSE2(const __m128i *a, const __m128i *b, __m128i threshold)
+    {
+        const auto pa = _mm_loadu_si128(a);
+        const auto pb = _mm_loadu_si128(b);
+        return _mm_subs_epu8(_mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa)), threshold);
+    }
+
+    SC_LITE_TARGET("sse2") static bool CompareThresholdSSE2(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, unsigned char threshold)
+    {
+        auto pa = reinterpret_cast<const __m128i *>(a);
+        auto pb = reinterpret_cast<const __m128i *>(b);
+        const auto thresholds = _mm_set1_epi32(static_cast<int>(ThresholdBytes(threshold)));
+        size_t i = 0;
+        for (; i + 16 <= npixels; i += 16, pa += 4, pb += 4) {
+            auto x0 = OverThresholdSSE2(pa, pb, thresholds);
+            auto x1 = OverThresholdSSE2(pa + 1, pb + 1, thresholds);
+            auto x2 = OverThresholdSSE2(pa + 2, pb + 2, thresholds);
+            auto x3 = OverThresholdSSE2(pa + 3, pb + 3, thresholds);
+            auto x = _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) {
+                return true;
+            }
+        }
+        for (; i + 4 <= npixels; i += 4, pa++, pb++) {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(OverThresholdSSE2(pa, pb, thresholds), _mm_setzero_si128())) != 0xFFFF) {
+                return true;
+            }
+        }
+        return CompareThresholdScalar(a + i, b + i, npixels - i, threshold);
+    }
+
+    // one bit per pixel that is different in the next 4 pixels
+    SC_LITE_TARGET("sse2") static unsigned int ChangedMaskSSE2(const ImageBGRA *a, const ImageBGRA *b)
+    {
+        auto x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b)));
+        auto equal = _mm_cmpeq_epi32(_mm_and_si128(x, _mm_set1_epi32(ColorMask)), _mm_setzero_si128());
+        return ~static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(equal))) & 0xF;
+    }
+
+    SC_LITE_TARGET("sse2") static bool FindChangesSSE2(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, size_t &first, size_t &last)
+    {
+        const auto changedmask = [&](size_t i) { return ChangedMaskSSE2(a + i, b + i); };
+        size_t i = 0;
+        for (; i + 4 <= npixels; i += 4) {
+            if (auto mask = changedmask(i)) {
+                first = i + LowestBit(mask);
+                break;
+            }
+        }
+        if (i + 4 > npixels) {
+            size_t tailfirst, taillast;
+            if (!FindChangesScalar(a + i, b + i, npixels - i, tailfirst, taillast)) {
+                return false;
+            }
+            first = i + tailfirst;
+            last = i + taillast;
+            return true;
+        }
+        // now from the back, 4 pixels at a time while they are all after first
+        auto end = npixels;
+        for (; end >= first + 4; end -= 4) {
+            if (auto mask = changedmask(end - 4)) {
+                last = end - 4 + HighestBit(mask);
+                return true;
+            }
+        }
+        last = FindLastChangeScalar(a, b, end, first);
+        return true;
+    }
+
+    // one bit per pixel that is different in the next 8 pixels
+    SC_LITE_TARGET("avx2") static unsigned int ChangedMaskAVX2(const ImageBGRA *a, const ImageBGRA *b)
+    {
+        auto x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b)));
+        auto equal = _mm256_cmpeq_epi32(_mm256_and_si256(x, _mm256_set1_epi32(ColorMask)), _mm256_setzero_si256());
+        return ~static_cast<unsigned int>(_mm256_movemask_ps(_mm256_castsi256_ps(equal))) & 0xFF;
+    }
+
+    SC_LITE_TARGET("avx2") static bool FindChangesAVX2(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, size_t &first, size_t &last)
+    {
+        const auto changedmask = [&](size_t i) { return ChangedMaskAVX2(a + i, b + i); };
+        size_t i = 0;
+        for (; i + 8 <= npixels; i += 8) {
+            if (auto mask = changedmask(i)) {
+                first = i + LowestBit(mask);
+                break;
+            }
+        }
+        if (i + 8 > npixels) {
+            size_t tailfirst, taillast;
+            if (!FindChangesSSE2(a + i, b + i, npixels - i, tailfirst, taillast)) {
+                return false;
+            }
+            first = i + tailfirst;
+            last = i + taillast;
+            return true;
+        }
+        auto end = npixels;
+        for (; end >= first + 8; end -= 8) {
+            if (auto mask = changedmask(end - 8)) {
+                last = end - 8 + HighestBit(mask);
+                return true;
+            }
+        }
+        last = FindLastChangeScalar(a, b, end, first);
+        return true;
+    }
+
+    SC_LITE_TARGET("avx2") static bool CompareAVX2(const ImageBGRA *a, const ImageBGRA *b, size_t npixels)
+    {
+        auto pa = reinterpret_cast<const __m256i *>(a);
+        auto pb = reinterpret_cast<const __m256i *>(b);
+        // testz ands with the mask for free
+        const auto colormask = _mm256_set1_epi32(ColorMask);
+        size_t i = 0;
+        // 32 pixels per iteration, the xors are or'ed together so there is only one branch for 128 bytes
+        for (; i + 32 <= npixels; i += 32, pa += 4, pb += 4) {
+            auto x0 = _mm256_xor_si256(_mm256_loadu_si256(pa), _mm256_loadu_si256(pb));
+            auto x1 = _mm256_xor_si256(_mm256_loadu_si256(pa + 1), _mm256_loadu_si256(pb + 1));
+            auto x2 = _mm256_xor_si256(_mm256_loadu_si256(pa + 2), _mm256_loadu_si256(pb + 2));
+            auto x3 = _mm256_xor_si256(_mm256_loadu_si256(pa + 3), _mm256_loadu_si256(pb + 3));
+            auto x = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+            if (!_mm256_testz_si256(x, colormask)) {
+                return true;
+            }
+        }
+        for (; i + 8 <= npixels; i += 8, pa++, pb++) {
+            auto x = _mm256_xor_si256(_mm256_loadu_si256(pa), _mm256_loadu_si256(pb));
+            if (!_mm256_testz_si256(x, colormask)) {
+                return true;
+            }
+        }
+        return CompareSSE2(a + i, b + i, npixels - i);
+    }
+
+    SC_LITE_TARGET("avx2") static __m256i OverThresholdAVX2(const __m256i *a, const __m256i *b, __m256i threshold)
+    {
+        const auto pa = _mm256_loadu_si256(a);
+        const auto pb = _mm256_loadu_si256(b);
+        return _mm256_subs_epu8(_mm256_or_si256(_mm256_subs_epu8(pa, pb), _mm256_subs_epu8(pb, pa)), threshold);
+    }
+
+    SC_LITE_TARGET("avx2") static bool CompareThresholdAVX2(const ImageBGRA *a, const ImageBGRA *b, size_t npixels, unsigned char threshold)
+    {
+        auto pa = reinterpret_cast<const __m256i *>(a);
+        auto pb = reinterpret_cast<const __m256i *>(b);
+        const auto thresholds = _mm256_set1_epi32(static_cast<int>(ThresholdBytes(threshold)));
+        size_t i = 0;
+        for (; i + 32 <= npixels; i += 32, pa += 4, pb += 4) {
+            auto x0 = OverThresholdAVX2(pa, pb, thresholds);
+            auto x1 = OverThresholdAVX2(pa + 1, pb + 1, thresholds);
+            auto x2 = OverThresholdAVX2(pa + 2, pb + 2, thresholds);
+            auto x3 = OverThresholdAVX2(pa + 3, pb + 3, thresholds);
+            auto x = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+            if (!_mm256_testz_si256(x, x)) {
+                return true;
+            }
+        }
+        for (; i + 8 <= npixels; i += 8, pa++, pb++) {
+            auto x = OverThresholdAVX2(pa, pb, thresholds);
+            if (!_mm256_testz_si256(x, x)) {
+                return true;
+            }
+        }
+        return CompareThresholdSSE2(a + i, b + i, npixels - i, threshold);
+    }
+
+#if defined(_M_X64) || defined(__x86_64__)
+    // crc32c of the even and odd 8 byte words in the low and high halves of the hash. Two independent crc chains also keep the crc unit busy
+    SC_LITE_TARGET("sse4.2") static uint64_t HashCRC32C(uint64_t seed, const ImageBGRA *a, size_t npixels)
+    {
+        auto p = reinterpret_cast<const unsigned char *>(a);
+        const auto end = p + npixels * sizeof(ImageBGRA);
+        auto lo = static_cast<uint64_t>(static_cast<uint32_t>(seed));
+        auto hi = seed >> 32;
+        for (; p + 2 * sizeof(uint64_t) <= end; p += 2 * sizeof(uint64_t)) {
+            uint64_t v0, v1;
+            memcpy(&v0, p, sizeof(v0));
+            memcpy(&v1, p + sizeof(v0), sizeof(v1));
+            lo = _mm_crc32_u64(lo, v0 & ColorMask2);
+            hi = _mm_crc32_u64(hi, v1 & ColorMask2);
+        }
+        for (; p + sizeof(uint32_t) <= end; p += sizeof(uint32_t)) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            lo = _mm_crc32_u32(static_cast<uint32_t>(lo), v & ColorMask);
+        }
+        return (hi << 32) | lo;
+    }
+#endif
+
+    static bool CpuSupportsAVX2()
+    {
+#if defined(_MSC_VER)
+        int info[4] = {0};
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        const auto osxsave = (info[2] & (1 << 27)) != 0;
+        const auto avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx) {
+            return false;
+        }
+        // the os must save the ymm registers on a context switch
+        if ((_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    static bool CpuSupportsSSE2()
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        return true; // sse2 is part of the x64 baseline
+#elif defined(_MSC_VER)
+        int info[4] = {0};
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+
+    static bool CpuSupportsSSE42()
+    {
+#if defined(_MSC_VER)
+        int info[4] = {0};
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+
+#endif
+
+    DiffKernels GetDiffKernels(DiffInstructionSet instructionset)
+    {
+        DiffKernels ret;
+        ret.InstructionSet = DiffInstructionSet::Scalar;
+        ret.Compare = &CompareScalar;
+        ret.Hash = &HashScalar;
+        ret.FindChanges = &FindChangesScalar;
+        ret.CompareThreshold = &CompareThresholdScalar;
+        ret.FindChangesThreshold = &FindChangesThreshold<CompareThresholdScalar>;
+#if defined(SC_LITE_X86)
+        if (instructionset == DiffInstructionSet::AVX2 && CpuSupportsAVX2()) {
+            ret.InstructionSet = DiffInstructionSet::AVX2;
+            ret.Compare = &CompareAVX2;
+            ret.FindChanges = &FindChangesAVX2;
+            ret.CompareThreshold = &CompareThresholdAVX2;
+            ret.FindChangesThreshold = &FindChangesThreshold<CompareThresholdAVX2>;
+        }
+        else if (instructionset != DiffInstructionSet::Scalar && CpuSupportsSSE2()) {
+            ret.InstructionSet = DiffInstructionSet::SSE2;
+            ret.Compare = &CompareSSE2;
+            ret.FindChanges = &FindChangesSSE2;
+            ret.CompareThreshold = &CompareThresholdSSE2;
+            ret.FindChangesThreshold = &FindChangesThreshold<CompareThresholdSSE2>;
+        }
+#if defined(_M_X64) || defined(__x86_64__)
+        if (instructionset != DiffInstructionSet::Scalar && CpuSupportsSSE42()) {
+            ret.Hash = &HashCRC32C;
+        }
+#endif
+#endif
+        return ret;
+    }
+
+    const DiffKernels &GetDiffKernels()
+    {
+        static const DiffKernels kernels = GetDiffKernels(DiffInstructionSet::AVX2);
+        return kernels;
+    }
+} // namespace Screen_Capture
+} // namespace SL
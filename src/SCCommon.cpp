@@ -1,10 +1,18 @@
 #include "internal/SCCommon.h"
+#include "internal/DiffKernels.h"
+#include "internal/WorkerPool.h"
 
 #include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace SL {
 namespace Screen_Capture {
@@ -26,49 +34,106 @@ namespace Screen_Capture {
         static const size_t BitsPerBlock = sizeof(Block) * 8;
 
       public:
-        BitMap(size_t height, size_t width) : Width(width), Height(height), Blocks((width * height) / BitsPerBlock + 1, 0) {}
-
-        bool get(size_t x, size_t y) const
+        // every row starts on a new block so different rows can be written from different threads. The bits are kept in blocks, which is cleared
+        // and reused so the memory can outlive the map
+        BitMap(std::vector<Block> &blocks, size_t height, size_t width)
+            : Width(width), Height(height), BlocksPerRow((width + BitsPerBlock - 1) / BitsPerBlock), Blocks(blocks)
         {
-            const size_t index = x * Width + y;
-            const size_t nblock = index / BitsPerBlock;
-            const size_t nbit = index % BitsPerBlock;
-
-            return Blocks[nblock] & (Block(1) << nbit);
+            Blocks.assign(BlocksPerRow * height, 0);
         }
 
-        void set(size_t x, size_t y)
-        {
-            const size_t index = x * Width + y;
-            const size_t nblock = index / BitsPerBlock;
-            const size_t nbit = index % BitsPerBlock;
+        bool get(size_t x, size_t y) const { return Blocks[x * BlocksPerRow + y / BitsPerBlock] & (Block(1) << (y % BitsPerBlock)); }
 
-            Blocks[nblock] |= (Block(1) << nbit);
-        }
+        void set(size_t x, size_t y) { Blocks[x * BlocksPerRow + y / BitsPerBlock] |= (Block(1) << (y % BitsPerBlock)); }
+
+        void clear(size_t x, size_t y) { Blocks[x * BlocksPerRow + y / BitsPerBlock] &= ~(Block(1) << (y % BitsPerBlock)); }
 
         size_t width() const { return Width; }
 
         size_t height() const { return Height; }
 
+        // the blocks of row x, bit i of block j is column j * BitsPerBlock + i
+        const Block *row(size_t x) const { return Blocks.data() + x * BlocksPerRow; }
+
+        size_t blocksPerRow() const { return BlocksPerRow; }
+
       private:
         size_t Width;
         size_t Height;
-        std::vector<Block> Blocks;
+        size_t BlocksPerRow;
+        std::vector<Block> &Blocks;
     };
 
-    static void merge(std::vector<ImageRect> &rects)
+    // what the diff of one frame produces
+    struct TileChanges {
+        TileChanges(DiffContext &context, size_t tilerows, size_t tilecols, const DiffOptions &options)
+            : Map(context.ChangedTiles, tilerows, tilecols), Bounds(context.TileBounds),
+              Damaged(context.DamagedTiles, context.HasDamage ? tilerows : 0, tilecols), HasDamage(context.HasDamage)
+        {
+            // a bound is only read once its tile is marked, so there is no need to clear them
+            Bounds.resize(options.TightRects ? tilerows * tilecols : 0);
+            for (size_t i = 0; HasDamage && i < context.Damage.size(); ++i) {
+                const auto &rect = context.Damage[i];
+                if (rect.right <= rect.left || rect.bottom <= rect.top) {
+                    continue;
+                }
+                const auto firstrow = static_cast<size_t>(std::max(rect.top, 0) / options.TileHeight);
+                const auto lastrow = std::min(static_cast<size_t>((rect.bottom - 1) / options.TileHeight), tilerows - 1);
+                const auto firstcol = static_cast<size_t>(std::max(rect.left, 0) / options.TileWidth);
+                const auto lastcol = std::min(static_cast<size_t>((rect.right - 1) / options.TileWidth), tilecols - 1);
+                for (auto tilerow = firstrow; tilerow <= lastrow; ++tilerow) {
+                    for (auto tilecol = firstcol; tilecol <= lastcol; ++tilecol) {
+                        Damaged.set(tilerow, tilecol);
+                    }
+                }
+            }
+        }
+
+        BitMap<uint64_t> Map;
+        // the bounding box of the changed pixels in each changed tile, only kept for DiffOptions::TightRects
+        std::vector<ImageRect> &Bounds;
+        // the tiles that DiffContext::Damage touches
+        BitMap<uint64_t> Damaged;
+        bool HasDamage;
+
+        // false when the tile is known to be the same as in the previous frame, so it does not need to be looked at
+        bool damaged(size_t tilerow, size_t tilecol) const { return !HasDamage || Damaged.get(tilerow, tilecol); }
+
+        // marks the tile as changed and grows its bounding box to include the changed pixels in rect
+        void add(size_t tilerow, size_t tilecol, const ImageRect &rect)
+        {
+            if (Bounds.empty()) {
+                Map.set(tilerow, tilecol);
+                return;
+            }
+            auto &bounds = Bounds[tilerow * Map.width() + tilecol];
+            if (!Map.get(tilerow, tilecol)) {
+                Map.set(tilerow, tilecol);
+                bounds = rect;
+            }
+            else {
+                bounds.left = std::min(bounds.left, rect.left);
+                bounds.top = std::min(bounds.top, rect.top);
+                bounds.right = std::max(bounds.right, rect.right);
+                bounds.bottom = std::max(bounds.bottom, rect.bottom);
+            }
+        }
+    };
+
+    // outrects and columns are only scratch space. rects must be in the order GetRects makes them, tile row by tile row from left to right
+    static void merge(std::vector<ImageRect> &rects, std::vector<ImageRect> &outrects, std::vector<size_t> &columns, int tilewidth,
+                      size_t tilecols)
     {
         if (rects.size() <= 2) {
             return; // make sure there is at least 2
         }
 
-        std::vector<ImageRect> outrects;
-        outrects.reserve(rects.size());
+        outrects.clear();
         outrects.push_back(rects[0]);
 
         // horizontal scan
         for (size_t i = 1; i < rects.size(); i++) {
-            if (outrects.back().right == rects[i].left && outrects.back().bottom == rects[i].bottom) {
+            if (outrects.back().right == rects[i].left && outrects.back().top == rects[i].top && outrects.back().bottom == rects[i].bottom) {
                 outrects.back().right = rects[i].right;
             }
             else {
@@ -77,102 +142,889 @@ namespace Screen_Capture {
         }
 
         if (outrects.size() <= 2) {
-            rects = std::move(outrects);
+            rects.swap(outrects);
             return; // make sure there is at least 2
         }
 
         rects.clear();
-        // vertical scan
+        // vertical scan. A rect can only grow into one that starts in the same column of tiles in the row of tiles below it, and no two rects of
+        // a row start in the same column, so only the last rect that started in each column has to be looked at
+        const auto none = std::numeric_limits<size_t>::max();
+        columns.assign(tilecols, none);
         for (auto &otrect : outrects) {
-            auto found = std::find_if(rects.rbegin(), rects.rend(), [=](const ImageRect &rec) {
-                return rec.bottom == otrect.top && rec.left == otrect.left && rec.right == otrect.right;
-            });
-
-            if (found == rects.rend()) {
-                rects.push_back(otrect);
+            auto &last = columns[static_cast<size_t>(otrect.left / tilewidth)];
+            if (last != none && rects[last].bottom == otrect.top && rects[last].left == otrect.left && rects[last].right == otrect.right) {
+                rects[last].bottom = otrect.bottom;
             }
             else {
-                found->bottom = otrect.bottom;
+                last = rects.size();
+                rects.push_back(otrect);
+            }
+        }
+    }
+
+    static int64_t Area(const ImageRect &rect) { return static_cast<int64_t>(Width(rect)) * Height(rect); }
+
+    static ImageRect Union(const ImageRect &a, const ImageRect &b)
+    {
+        return ImageRect(std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right), std::max(a.bottom, b.bottom));
+    }
+
+    // how many rects on each side of a rect, in the order GetRects made them (tile row by tile row), are looked at when finding the cheapest
+    // one to merge it with. Looking at all of them is O(n^2) per merge, far too slow for the thousands of rects small tiles can give. Rects
+    // further away in that order are rarely the cheapest, and the rects left get closer together as they are merged
+    static const size_t MergeNeighbours = 16;
+
+    // merges the pair of rects with the lowest cost until done says the cheapest pair left should not be merged. cost is given both rects and
+    // how many of their pixels were reported as changed before any merging
+    template <class C, class D> static void MergeCheapest(std::vector<ImageRect> &rects, DiffContext &context, const C &cost, const D &done)
+    {
+        const auto count = rects.size();
+        if (count < 2) {
+            return;
+        }
+        // the rects not merged into another yet, as a list in their original order. end marks both ends of the list and removed marks the
+        // rects that were merged away
+        const auto end = count, removed = count + 1;
+        auto &prev = context.MergePrev;
+        auto &next = context.MergeNext;
+        prev.resize(count);
+        next.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            prev[i] = i == 0 ? end : i - 1;
+            next[i] = i + 1;
+        }
+        // the rect that is cheapest to merge each rect with and what that costs. The heap holds the cheapest costs, an entry is out of date
+        // once the cost it holds is no longer the cost of its rect
+        auto &best = context.MergeBest;
+        auto &bestcost = context.MergeCost;
+        auto &heap = context.MergeHeap;
+        auto &area = context.MergeArea;
+        best.resize(count);
+        bestcost.resize(count);
+        area.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            area[i] = Area(rects[i]);
+        }
+        heap.clear();
+        const auto push = [&](size_t i) {
+            heap.emplace_back(bestcost[i], i);
+            std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<double, size_t>>());
+        };
+        const auto findbest = [&](size_t i) {
+            bestcost[i] = std::numeric_limits<double>::max();
+            auto forward = next[i], backward = prev[i];
+            for (size_t n = 0; n < MergeNeighbours; n++) {
+                for (auto j : {forward, backward}) {
+                    if (j == end) {
+                        continue;
+                    }
+                    const auto c = cost(rects[i], area[i], rects[j], area[j]);
+                    if (c < bestcost[i]) {
+                        bestcost[i] = c;
+                        best[i] = j;
+                    }
+                }
+                forward = forward == end ? end : next[forward];
+                backward = backward == end ? end : prev[backward];
+            }
+            if (bestcost[i] < std::numeric_limits<double>::max()) {
+                push(i);
+            }
+        };
+        // calls f for the rects up to MergeNeighbours away from i in both directions, starting with i. A rect's best is always one of these,
+        // and they only get closer as rects are merged away
+        const auto neighbours = [&](size_t i, const auto &f) {
+            for (auto step : {&next, &prev}) {
+                for (size_t n = 0, k = i; n < MergeNeighbours && k != end; n++, k = (*step)[k]) {
+                    f(k);
+                }
+            }
+        };
+        for (size_t i = 0; i < count; i++) {
+            findbest(i);
+        }
+
+        auto left = count;
+        while (left > 1 && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<double, size_t>>());
+            const auto entry = heap.back();
+            heap.pop_back();
+            const auto i = entry.second;
+            if (prev[i] == removed || entry.first != bestcost[i]) {
+                continue;
+            }
+            if (done(left, entry.first)) {
+                break;
+            }
+            // the merged rect takes the place of i and j is taken out of the list
+            const auto j = best[i];
+            rects[i] = Union(rects[i], rects[j]);
+            area[i] += area[j];
+            const auto before = prev[j], after = next[j];
+            if (before != end) {
+                next[before] = after;
+            }
+            if (after != end) {
+                prev[after] = before;
+            }
+            prev[j] = removed;
+            left -= 1;
+
+            findbest(i);
+            neighbours(i, [&](size_t k) {
+                if (k == i) {
+                    return;
+                }
+                if (best[k] == i || best[k] == j) {
+                    findbest(k);
+                    return;
+                }
+                const auto c = cost(rects[k], area[k], rects[i], area[i]);
+                if (c < bestcost[k]) {
+                    bestcost[k] = c;
+                    best[k] = i;
+                    push(k);
+                }
+            });
+            // the rects that had j as their best are all near where it was
+            for (auto from : {before, after}) {
+                if (from != end) {
+                    neighbours(from, [&](size_t k) {
+                        if (best[k] == j) {
+                            findbest(k);
+                        }
+                    });
+                }
+            }
+            // the out of date entries are dropped now and then so the heap stays about the size of the rects
+            if (heap.size() > 4 * count) {
+                heap.clear();
+                for (size_t k = 0; k < count; k++) {
+                    if (prev[k] != removed && bestcost[k] < std::numeric_limits<double>::max()) {
+                        heap.emplace_back(bestcost[k], k);
+                    }
+                }
+                std::make_heap(heap.begin(), heap.end(), std::greater<std::pair<double, size_t>>());
             }
         }
+        // the rects left keep their order
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (prev[i] != removed) {
+                rects[kept++] = rects[i];
+            }
+        }
+        rects.resize(kept);
+    }
+
+    // merges rects that are close enough to be cheaper to send as one, see DiffOptions::MaxOverdraw and DiffOptions::MaxRects
+    static void merge(std::vector<ImageRect> &rects, DiffContext &context, const DiffOptions &options)
+    {
+        if (options.MaxOverdraw > 1.0f) {
+            MergeCheapest(
+                rects, context,
+                [](const ImageRect &a, int64_t areaa, const ImageRect &b, int64_t areab) {
+                    // against the pixels that changed, not the rects, or the overdraw of every earlier merge would be allowed again
+                    return static_cast<double>(Area(Union(a, b))) / static_cast<double>(areaa + areab);
+                },
+                [&](size_t, double overdraw) { return overdraw > options.MaxOverdraw; });
+        }
+        if (options.MaxRects > 0 && rects.size() > static_cast<size_t>(options.MaxRects)) {
+            MergeCheapest(
+                rects, context,
+                [](const ImageRect &a, int64_t, const ImageRect &b, int64_t) {
+                    return static_cast<double>(Area(Union(a, b)) - Area(a) - Area(b));
+                },
+                [&](size_t count, double) { return count <= static_cast<size_t>(options.MaxRects); });
+        }
     }
 
-#define maxdist 256
+    // index of the lowest set bit, block must not be zero
+    static unsigned int LowestBit(uint64_t block)
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index;
+        _BitScanForward64(&index, block);
+        return index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, static_cast<unsigned long>(block))) {
+            return index;
+        }
+        _BitScanForward(&index, static_cast<unsigned long>(block >> 32));
+        return index + 32;
+#else
+        return __builtin_ctzll(block);
+#endif
+    }
 
-    static std::vector<ImageRect> GetRects(const BitMap<uint64_t> &map)
+    static void GetRects(std::vector<ImageRect> &rects, const TileChanges &changes, int tilewidth, int tileheight)
     {
-        std::vector<ImageRect> rects;
-        rects.reserve(map.width() * map.height());
+        const auto &map = changes.Map;
+        rects.clear();
 
-        for (decltype(map.height()) x = 0; x < map.height(); ++x) {
-            for (decltype(map.width()) y = 0; y < map.width(); ++y) {
-                if (map.get(x, y)) {
+        // only the set bits are visited, so this costs the number of changed tiles plus one test per 64 tiles
+        for (size_t x = 0; x < map.height(); ++x) {
+            const auto row = map.row(x);
+            for (size_t block = 0; block < map.blocksPerRow(); ++block) {
+                for (auto bits = row[block]; bits; bits &= bits - 1) {
+                    const auto y = block * 64 + LowestBit(bits);
+                    if (!changes.Bounds.empty()) {
+                        rects.push_back(changes.Bounds[x * map.width() + y]);
+                        continue;
+                    }
                     ImageRect rect;
 
-                    rect.top = static_cast<decltype(rect.top)>(x * maxdist);
-                    rect.bottom = static_cast<decltype(rect.bottom)>((x + 1) * maxdist);
+                    rect.top = static_cast<decltype(rect.top)>(x * tileheight);
+                    rect.bottom = static_cast<decltype(rect.bottom)>((x + 1) * tileheight);
 
-                    rect.left = static_cast<decltype(rect.left)>(y * maxdist);
-                    rect.right = static_cast<decltype(rect.right)>((y + 1) * maxdist);
+                    rect.left = static_cast<decltype(rect.left)>(y * tilewidth);
+                    rect.right = static_cast<decltype(rect.right)>((y + 1) * tilewidth);
 
                     rects.push_back(rect);
                 }
             }
         }
+    }
 
-        return rects;
+    // cools every tile down and heats up the ones that changed, see DiffOptions::HeatDecay. Only the change map is read, not the pixels. Tiles that
+    // are too hot are taken out of the change map, once they cool down they are put back as a whole tile so the caller catches up with every
+    // change that was left out
+    static void UpdateHeat(DiffContext &context, TileChanges &changes, const DiffOptions &options)
+    {
+        auto &map = changes.Map;
+        const auto tilecount = map.width() * map.height();
+        if (context.TileHeat.size() != tilecount) {
+            context.TileHeat.assign(tilecount, 0.0f);
+            context.HotTiles.assign(tilecount, 0);
+        }
+        const auto warmup = 1.0f - options.HeatDecay;
+        const auto leaveout = options.MaxHeat < 1.0f;
+        for (size_t x = 0, i = 0; x < map.height(); ++x) {
+            for (size_t y = 0; y < map.width(); ++y, ++i) {
+                auto &heat = context.TileHeat[i];
+                const auto changed = map.get(x, y);
+                heat = heat * options.HeatDecay + (changed ? warmup : 0.0f);
+                if (!leaveout) {
+                    continue;
+                }
+                if (heat > options.MaxHeat) {
+                    context.HotTiles[i] |= changed ? 1 : 0;
+                    map.clear(x, y);
+                }
+                else if (context.HotTiles[i]) {
+                    context.HotTiles[i] = 0;
+                    map.set(x, y);
+                    if (!changes.Bounds.empty()) {
+                        changes.Bounds[i] = ImageRect(static_cast<int>(y * options.TileWidth), static_cast<int>(x * options.TileHeight),
+                                                      static_cast<int>((y + 1) * options.TileWidth), static_cast<int>((x + 1) * options.TileHeight));
+                    }
+                }
+            }
+        }
     }
 
-    std::vector<ImageRect> GetDifs(const Image &oldImage, const Image &newImage)
+    // the kernels to use for options.Threshold
+    static bool Compare(const DiffKernels &kernels, const DiffOptions &options, const ImageBGRA *a, const ImageBGRA *b, size_t npixels)
+    {
+        return options.Threshold ? kernels.CompareThreshold(a, b, npixels, options.Threshold) : kernels.Compare(a, b, npixels);
+    }
+    static bool FindChanges(const DiffKernels &kernels, const DiffOptions &options, const ImageBGRA *a, const ImageBGRA *b, size_t npixels,
+                            size_t &first, size_t &last)
     {
-        auto old_ptr = (const int *)StartSrc(oldImage);
-        auto new_ptr = (const int *)StartSrc(newImage);
+        return options.Threshold ? kernels.FindChangesThreshold(a, b, npixels, options.Threshold, first, last)
+                                 : kernels.FindChanges(a, b, npixels, first, last);
+    }
 
-        const auto width = Width(newImage);
-        const auto height = Height(newImage);
+    // the index of the pixel at row, col of a frame kept one tile after another, see DiffReference::TiledPixels. The tiles are in the same order
+    // as the change map and each one is kept row by row, so the tiles in the last row and column are smaller
+    static size_t TiledOffset(size_t row, size_t col, size_t width, size_t height, const DiffOptions &options)
+    {
+        const auto tilewidth = static_cast<size_t>(options.TileWidth);
+        const auto tileheight = static_cast<size_t>(options.TileHeight);
+        const auto top = row / tileheight * tileheight;
+        const auto left = col / tilewidth * tilewidth;
+        return top * width + left * std::min(tileheight, height - top) + (row - top) * std::min(tilewidth, width - left) + (col - left);
+    }
 
-        const auto width_chunks = width / maxdist;
-        const auto height_chunks = height / maxdist;
+    // marks the tiles in rows [firsttilerow, lasttilerow) of the change map that are different between the two images. When update is set, it
+    // points at the writable pixels of oldImage and every changed tile is copied into it from newImage in the same pass
+    static void GetDifs(TileChanges &changes, const Image &oldImage, unsigned char *update, const Image &newImage, const DiffOptions &options,
+                        size_t firsttilerow, size_t lasttilerow)
+    {
+        const auto &kernels = GetDiffKernels();
+        const auto width = static_cast<size_t>(Width(newImage));
+        const auto height = static_cast<size_t>(Height(newImage));
+        const auto tilewidth = static_cast<size_t>(options.TileWidth);
+        const auto tileheight = static_cast<size_t>(options.TileHeight);
+        // BytesToNextRow is the padding at the end of each row here
+        const auto oldstride = width * sizeof(ImageBGRA) + oldImage.BytesToNextRow;
+        const auto newstride = width * sizeof(ImageBGRA) + newImage.BytesToNextRow;
+        const auto oldstart = reinterpret_cast<const unsigned char *>(StartSrc(oldImage));
+        const auto newstart = reinterpret_cast<const unsigned char *>(StartSrc(newImage));
+        auto &map = changes.Map;
+        const auto threshold = options.Threshold;
 
-        const auto line_rem = width % maxdist;
-        const auto bottom_rem = height % maxdist;
+        for (auto tilerow = firsttilerow; tilerow < lasttilerow; ++tilerow) {
+            const auto bottom = std::min((tilerow + 1) * tileheight, height);
+            for (auto row = tilerow * tileheight; row < bottom; ++row) {
+                auto old_ptr = reinterpret_cast<const ImageBGRA *>(oldstart + row * oldstride);
+                auto new_ptr = reinterpret_cast<const ImageBGRA *>(newstart + row * newstride);
+                auto update_ptr = update ? update + row * oldstride : nullptr;
+                for (size_t tilecol = 0; tilecol < map.width(); ++tilecol) {
+                    const auto left = tilecol * tilewidth;
+                    const auto npixels = std::min(tilewidth, width - left);
+                    if (!changes.damaged(tilerow, tilecol)) {
+                        continue;
+                    }
+                    if (options.TightRects) {
+                        // every row has to be looked at to find the bounding box of the changes
+                        size_t first, last;
+                        if (FindChanges(kernels, options, old_ptr + left, new_ptr + left, npixels, first, last)) {
+                            changes.add(tilerow, tilecol,
+                                        ImageRect(static_cast<int>(left + first), static_cast<int>(row), static_cast<int>(left + last + 1),
+                                                  static_cast<int>(row + 1)));
+                            if (update_ptr) {
+                                memcpy(update_ptr + (left + first) * sizeof(ImageBGRA), new_ptr + left + first,
+                                       (last - first + 1) * sizeof(ImageBGRA));
+                            }
+                        }
+                    }
+                    else if (map.get(tilerow, tilecol)) {
+                        // the rows of this tile above here were identical, so only the rest of the tile needs to be brought up to date
+                        if (update_ptr) {
+                            memcpy(update_ptr + left * sizeof(ImageBGRA), new_ptr + left, npixels * sizeof(ImageBGRA));
+                        }
+                    }
+                    else if (Compare(kernels, options, old_ptr + left, new_ptr + left, npixels)) {
+                        map.set(tilerow, tilecol);
+                        // with a threshold the rows of the tile above here could have changed by a little. The whole tile is reported, so
+                        // they are brought up to date as well
+                        const auto firstrow = threshold ? tilerow * tileheight : row;
+                        for (auto r = firstrow; update && r <= row; ++r) {
+                            memcpy(update + r * oldstride + left * sizeof(ImageBGRA), newstart + r * newstride + left * sizeof(ImageBGRA),
+                                   npixels * sizeof(ImageBGRA));
+                        }
+                    }
+                }
+            }
+        }
+    }
 
-        BitMap<uint64_t> changes{static_cast<size_t>(height_chunks) + 1, static_cast<size_t>(width_chunks) + 1};
+    // the same as GetDifs above for a previous frame kept one tile after another, see DiffReference::TiledPixels. The tiles are visited one at a
+    // time, so the previous frame is read in one contiguous run per tile instead of one short run per row
+    static void GetTiledDifs(TileChanges &changes, unsigned char *tiled, const Image &newImage, const DiffOptions &options, size_t firsttilerow,
+                             size_t lasttilerow)
+    {
+        const auto &kernels = GetDiffKernels();
+        const auto width = static_cast<size_t>(Width(newImage));
+        const auto height = static_cast<size_t>(Height(newImage));
+        const auto tilewidth = static_cast<size_t>(options.TileWidth);
+        const auto tileheight = static_cast<size_t>(options.TileHeight);
+        const auto newstride = width * sizeof(ImageBGRA) + newImage.BytesToNextRow;
+        const auto newstart = reinterpret_cast<const unsigned char *>(StartSrc(newImage));
+        const auto newrow = [&](size_t row) { return reinterpret_cast<const ImageBGRA *>(newstart + row * newstride); };
 
-        const auto compare = [&](size_t x, size_t y, size_t npixels) {
-            if (!changes.get(x, y)) {
-                if (memcmp(old_ptr, new_ptr, npixels * sizeof(int))) {
-                    changes.set(x, y);
+        for (auto tilerow = firsttilerow; tilerow < lasttilerow; ++tilerow) {
+            const auto top = tilerow * tileheight;
+            const auto bottom = std::min(top + tileheight, height);
+            for (size_t tilecol = 0; tilecol < changes.Map.width(); ++tilecol) {
+                const auto left = tilecol * tilewidth;
+                const auto npixels = std::min(tilewidth, width - left);
+                const auto tile = reinterpret_cast<ImageBGRA *>(tiled) + TiledOffset(top, left, width, height, options);
+                for (auto row = top; changes.damaged(tilerow, tilecol) && row < bottom; ++row) {
+                    const auto old_ptr = tile + (row - top) * npixels;
+                    const auto new_ptr = newrow(row) + left;
+                    if (options.TightRects) {
+                        size_t first, last;
+                        if (FindChanges(kernels, options, old_ptr, new_ptr, npixels, first, last)) {
+                            changes.add(tilerow, tilecol,
+                                        ImageRect(static_cast<int>(left + first), static_cast<int>(row), static_cast<int>(left + last + 1),
+                                                  static_cast<int>(row + 1)));
+                            memcpy(old_ptr + first, new_ptr + first, (last - first + 1) * sizeof(ImageBGRA));
+                        }
+                    }
+                    else if (Compare(kernels, options, old_ptr, new_ptr, npixels)) {
+                        changes.Map.set(tilerow, tilecol);
+                        // the rest of the tile is brought up to date without comparing it, with a threshold the rows above here are too
+                        for (auto r = options.Threshold ? top : row; r < bottom; ++r) {
+                            memcpy(tile + (r - top) * npixels, newrow(r) + left, npixels * sizeof(ImageBGRA));
+                        }
+                        break;
+                    }
                 }
             }
+        }
+    }
 
-            old_ptr += npixels;
-            new_ptr += npixels;
-        };
+    // hashes every tile in rows [firsttilerow, lasttilerow) into hashes and marks the ones whose hash is different from the one in tilehashes,
+    // which is then replaced. When verify is set it points at a tightly packed copy of the previous frame, tiles whose hash did not change are
+    // compared against it and changed tiles are copied into it
+    static void GetHashDifs(TileChanges &changes, uint64_t *tilehashes, uint64_t *newtilehashes, unsigned char *verify, const Image &newImage,
+                            const DiffOptions &options, size_t firsttilerow, size_t lasttilerow)
+    {
+        const auto &kernels = GetDiffKernels();
+        const auto width = static_cast<size_t>(Width(newImage));
+        const auto height = static_cast<size_t>(Height(newImage));
+        const auto tilewidth = static_cast<size_t>(options.TileWidth);
+        const auto tileheight = static_cast<size_t>(options.TileHeight);
+        const auto tilecols = changes.Map.width();
+        const auto oldstride = width * sizeof(ImageBGRA);
+        const auto newstride = width * sizeof(ImageBGRA) + newImage.BytesToNextRow;
+        const auto newstart = reinterpret_cast<const unsigned char *>(StartSrc(newImage));
 
-        for (int x = 0; x < height_chunks; ++x) {
-            for (int i = 0; i < maxdist; ++i) { // for each row in current line of chunks
-                for (int y = 0; y < width_chunks; ++y) {
-                    compare(x, y, maxdist);
+        for (auto tilerow = firsttilerow; tilerow < lasttilerow; ++tilerow) {
+            const auto top = tilerow * tileheight;
+            const auto bottom = std::min(top + tileheight, height);
+            auto hashes = newtilehashes + tilerow * tilecols;
+            std::fill(hashes, hashes + tilecols, 0);
+            for (auto row = top; row < bottom; ++row) {
+                auto new_ptr = reinterpret_cast<const ImageBGRA *>(newstart + row * newstride);
+                for (size_t tilecol = 0; tilecol < tilecols; ++tilecol) {
+                    const auto left = tilecol * tilewidth;
+                    if (changes.damaged(tilerow, tilecol)) {
+                        hashes[tilecol] = kernels.Hash(hashes[tilecol], new_ptr + left, std::min(tilewidth, width - left));
+                    }
                 }
-                compare(x, width_chunks, line_rem);
+            }
+
+            auto oldhashes = tilehashes + tilerow * tilecols;
+            for (size_t tilecol = 0; tilecol < tilecols; ++tilecol) {
+                const auto left = tilecol * tilewidth;
+                const auto npixels = std::min(tilewidth, width - left);
+                if (!changes.damaged(tilerow, tilecol)) {
+                    continue; // the hash of the previous frame is still the right one
+                }
+                auto changed = hashes[tilecol] != oldhashes[tilecol];
+                for (auto row = top; verify && !changed && row < bottom; ++row) {
+                    changed = kernels.Compare(reinterpret_cast<const ImageBGRA *>(verify + row * oldstride) + left,
+                                              reinterpret_cast<const ImageBGRA *>(newstart + row * newstride) + left, npixels);
+                }
+                if (changed) {
+                    oldhashes[tilecol] = hashes[tilecol];
+                    for (auto row = top; verify && options.TightRects && row < bottom; ++row) {
+                        size_t first, last;
+                        if (kernels.FindChanges(reinterpret_cast<const ImageBGRA *>(verify + row * oldstride) + left,
+                                                reinterpret_cast<const ImageBGRA *>(newstart + row * newstride) + left, npixels, first, last)) {
+                            changes.add(tilerow, tilecol,
+                                        ImageRect(static_cast<int>(left + first), static_cast<int>(row), static_cast<int>(left + last + 1),
+                                                  static_cast<int>(row + 1)));
+                        }
+                    }
+                    if (!changes.Map.get(tilerow, tilecol)) {
+                        changes.add(tilerow, tilecol,
+                                    ImageRect(static_cast<int>(left), static_cast<int>(top), static_cast<int>(left + npixels),
+                                              static_cast<int>(bottom)));
+                    }
+                    for (auto row = top; verify && row < bottom; ++row) {
+                        memcpy(verify + row * oldstride + left * sizeof(ImageBGRA), newstart + row * newstride + left * sizeof(ImageBGRA),
+                               npixels * sizeof(ImageBGRA));
+                    }
+                }
+            }
+        }
+    }
+
+    // the fewest changed rows or columns that are reported as a move, anything less is cheaper to send as a change
+    static const size_t MinMoveLength = 16;
+
+    // hashes each row of each column of tiles into hashes[tilecol * height + row]
+    static void HashRows(std::vector<uint64_t> &hashes, const unsigned char *start, size_t stride, size_t width, size_t height, size_t tilewidth)
+    {
+        const auto &kernels = GetDiffKernels();
+        const auto tilecols = (width + tilewidth - 1) / tilewidth;
+        hashes.resize(tilecols * height);
+        for (size_t row = 0; row < height; ++row) {
+            auto ptr = reinterpret_cast<const ImageBGRA *>(start + row * stride);
+            for (size_t tilecol = 0; tilecol < tilecols; ++tilecol) {
+                const auto left = tilecol * tilewidth;
+                hashes[tilecol * height + row] = kernels.Hash(0, ptr + left, std::min(tilewidth, width - left));
+            }
+        }
+    }
+
+    // hashes each column of each row of tiles into hashes[tilerow * width + column]
+    static void HashColumns(std::vector<uint64_t> &hashes, const unsigned char *start, size_t stride, size_t width, size_t height, size_t tileheight)
+    {
+        const auto tilerows = (height + tileheight - 1) / tileheight;
+        hashes.assign(tilerows * width, 0);
+        for (size_t row = 0; row < height; ++row) {
+            auto ptr = reinterpret_cast<const ImageBGRA *>(start + row * stride);
+            auto h = hashes.data() + (row / tileheight) * width;
+            for (size_t column = 0; column < width; ++column) {
+                uint32_t pixel;
+                memcpy(&pixel, ptr + column, sizeof(pixel));
+                h[column] = (h[column] ^ (pixel & 0x00FFFFFF)) * 0x9E3779B97F4A7C15ull;
+                h[column] ^= h[column] >> 32;
+            }
+        }
+    }
+
+    // finds the shift that the most changed entries of newhashes agree on, by looking up the ones that appear exactly once in oldhashes. Then calls
+    // onrun(first, end, delta) for every run [first, end) of at least MinMoveLength entries of newhashes that match oldhashes shifted by delta
+    template <class F>
+    static void FindShift(DiffContext &context, const uint64_t *oldhashes, const uint64_t *newhashes, size_t count, const F &onrun)
+    {
+        auto &sorted = context.SortedHashes;
+        auto &votes = context.MoveVotes;
+        sorted.clear();
+        votes.clear();
+        votes.reserve(count); // so the number of votes in a frame never makes it allocate
+        if (std::equal(oldhashes, oldhashes + count, newhashes)) {
+            return; // nothing changed
+        }
+        for (size_t i = 0; i < count; i++) {
+            sorted.emplace_back(oldhashes[i], i);
+        }
+        std::sort(sorted.begin(), sorted.end());
+        const auto byhash = [](const std::pair<uint64_t, size_t> &a, const std::pair<uint64_t, size_t> &b) { return a.first < b.first; };
+        for (size_t i = 0; i < count; i++) {
+            if (oldhashes[i] == newhashes[i]) {
+                continue;
+            }
+            auto found = std::equal_range(sorted.begin(), sorted.end(), std::make_pair(newhashes[i], size_t(0)), byhash);
+            if (found.second - found.first == 1) {
+                votes.push_back(static_cast<int>(i) - static_cast<int>(found.first->second));
+            }
+        }
+        if (votes.empty()) {
+            return;
+        }
+        std::sort(votes.begin(), votes.end());
+        auto delta = votes[0];
+        size_t bestcount = 0;
+        for (size_t i = 0, j = 0; i < votes.size(); i = j) {
+            for (j = i; j < votes.size() && votes[j] == votes[i]; j++) {
+            }
+            if (j - i > bestcount) {
+                bestcount = j - i;
+                delta = votes[i];
             }
         }
 
-        for (int i = 0; i < bottom_rem; ++i) {
-            for (int y = 0; y < width_chunks; ++y) {
-                compare(height_chunks, y, maxdist);
+        // the runs that moved by delta. Runs of identical rows, like a blank background, match any shift, so a run is only worth reporting when
+        // it saves at least MinMoveLength entries from being sent as changed
+        const auto begin = static_cast<size_t>(std::max(delta, 0));
+        const auto end = static_cast<size_t>(std::min(static_cast<int>(count), static_cast<int>(count) + delta));
+        auto runstart = begin;
+        size_t changed = 0;
+        for (auto i = begin; i <= end; i++) {
+            if (i < end && newhashes[i] == oldhashes[i - delta]) {
+                changed += newhashes[i] != oldhashes[i] ? 1 : 0;
+                continue;
+            }
+            if (changed >= MinMoveLength) {
+                onrun(runstart, i, delta);
             }
+            runstart = i + 1;
+            changed = 0;
+        }
+    }
 
-            compare(height_chunks, width_chunks, line_rem);
+    // copies the source of the move in img to where it moved to
+    static void ApplyMove(unsigned char *img, size_t width, const MoveRect &move)
+    {
+        const auto stride = width * sizeof(ImageBGRA);
+        const auto rowbytes = Width(move.Source) * sizeof(ImageBGRA);
+        // moving down has to start at the bottom so no row is overwritten before it is copied
+        const auto down = move.DeltaY > 0;
+        for (auto i = 0; i < Height(move.Source); i++) {
+            const auto row = down ? move.Source.bottom - 1 - i : move.Source.top + i;
+            auto src = img + row * stride + move.Source.left * sizeof(ImageBGRA);
+            auto dst = img + (row + move.DeltaY) * stride + (move.Source.left + move.DeltaX) * sizeof(ImageBGRA);
+            memmove(dst, src, rowbytes);
         }
+    }
 
-        auto rects = GetRects(changes);
-        merge(rects);
+    // finds what moved between oldimg and newImage, see DiffOptions::Moves, and applies it to oldimg
+    static void FindMoves(DiffContext &context, unsigned char *oldimg, const Image &newImage, const DiffOptions &options)
+    {
+        context.Moves.clear();
+        if (options.Moves == DiffMoves::None) {
+            return;
+        }
+        // a tile that was too hot to report has changes the caller never got, moving it would spread them to tiles that then look unchanged.
+        // Moves are looked for again once every such tile has been put back, the hashes kept from before are stale by then
+        if (std::any_of(context.HotTiles.begin(), context.HotTiles.end(), [](unsigned char hot) { return hot != 0; })) {
+            context.RowHashes.clear();
+            context.ColumnHashes.clear();
+            return;
+        }
+        const auto width = static_cast<size_t>(Width(newImage));
+        const auto height = static_cast<size_t>(Height(newImage));
+        const auto tilewidth = static_cast<size_t>(options.TileWidth);
+        const auto tileheight = static_cast<size_t>(options.TileHeight);
+        const auto oldstride = width * sizeof(ImageBGRA);
+        const auto newstride = width * sizeof(ImageBGRA) + newImage.BytesToNextRow;
+        const auto newstart = reinterpret_cast<const unsigned char *>(StartSrc(newImage));
+        const auto vertical = options.Moves == DiffMoves::Vertical || options.Moves == DiffMoves::Both;
+        const auto horizontal = options.Moves == DiffMoves::Horizontal || options.Moves == DiffMoves::Both;
+
+        // the hashes of the previous frame are kept from the last call, since oldimg ended up equal to that frame. They only need to be worked
+        // out again when there are none for a frame of this size
+        if (vertical) {
+            HashRows(context.NewRowHashes, newstart, newstride, width, height, tilewidth);
+            if (context.RowHashes.size() != context.NewRowHashes.size()) {
+                HashRows(context.RowHashes, oldimg, oldstride, width, height, tilewidth);
+            }
+            for (size_t left = 0; left < width; left += tilewidth) {
+                const auto right = std::min(left + tilewidth, width);
+                const auto offset = (left / tilewidth) * height;
+                FindShift(context, context.RowHashes.data() + offset, context.NewRowHashes.data() + offset, height,
+                          [&](size_t first, size_t end, int delta) {
+                              MoveRect move;
+                              move.Source = ImageRect(static_cast<int>(left), static_cast<int>(first) - delta, static_cast<int>(right),
+                                                      static_cast<int>(end) - delta);
+                              move.DeltaY = delta;
+                              // the same move in the column of tiles to the left grows to include this one
+                              auto &moves = context.Moves;
+                              if (!moves.empty() && moves.back().Source.right == move.Source.left && moves.back().Source.top == move.Source.top &&
+                                  moves.back().Source.bottom == move.Source.bottom && moves.back().DeltaY == move.DeltaY) {
+                                  moves.back().Source.right = move.Source.right;
+                              }
+                              else {
+                                  moves.push_back(move);
+                              }
+                          });
+            }
+        }
+        if (horizontal) {
+            HashColumns(context.NewColumnHashes, newstart, newstride, width, height, tileheight);
+            if (context.ColumnHashes.size() != context.NewColumnHashes.size()) {
+                HashColumns(context.ColumnHashes, oldimg, oldstride, width, height, tileheight);
+            }
+            // a frame is very unlikely to scroll both ways at once, so this is only looked for when nothing moved vertically
+            const auto movedvertically = !context.Moves.empty();
+            for (size_t top = 0; top < height && !movedvertically; top += tileheight) {
+                const auto bottom = std::min(top + tileheight, height);
+                const auto offset = (top / tileheight) * width;
+                FindShift(context, context.ColumnHashes.data() + offset, context.NewColumnHashes.data() + offset, width,
+                          [&](size_t first, size_t end, int delta) {
+                              MoveRect move;
+                              move.Source = ImageRect(static_cast<int>(first) - delta, static_cast<int>(top), static_cast<int>(end) - delta,
+                                                      static_cast<int>(bottom));
+                              move.DeltaX = delta;
+                              auto &moves = context.Moves;
+                              if (!moves.empty() && moves.back().Source.bottom == move.Source.top && moves.back().Source.left == move.Source.left &&
+                                  moves.back().Source.right == move.Source.right && moves.back().DeltaX == move.DeltaX) {
+                                  moves.back().Source.bottom = move.Source.bottom;
+                              }
+                              else {
+                                  moves.push_back(move);
+                              }
+                          });
+            }
+        }
+        for (auto &move : context.Moves) {
+            ApplyMove(oldimg, width, move);
+        }
+        // once the changes are copied in, oldimg is the new frame so its hashes are the ones for the next call
+        context.RowHashes.swap(context.NewRowHashes);
+        context.ColumnHashes.swap(context.NewColumnHashes);
+    }
+
+    // the cheap check run before the full diff, see DiffOptions::SampleRows. Returns false when there is damage information without any damage or
+    // the sampled rows show that nothing changed since the last diff. oldImage is the previous frame, or null when only tile hashes are kept and a
+    // checksum of the sampled rows is used instead
+    static bool MightHaveChanged(DiffContext &context, const Image *oldImage, const Image &newImage, const DiffOptions &options, bool tiled = false)
+    {
+        if (context.HasDamage) {
+            // the damage says where to look. Sampling could skip the rows it covers, and once a diff has used the damage up the change would
+            // never be looked for again
+            context.SkippedFrames = 0;
+            return !context.Damage.empty();
+        }
+        if (options.SampleRows <= 0) {
+            return true;
+        }
+        const auto &kernels = GetDiffKernels();
+        const auto width = static_cast<size_t>(Width(newImage));
+        const auto height = static_cast<size_t>(Height(newImage));
+        const auto stride = static_cast<size_t>(options.SampleRows);
+        const auto newstride = width * sizeof(ImageBGRA) + newImage.BytesToNextRow;
+        const auto newstart = reinterpret_cast<const unsigned char *>(StartSrc(newImage));
+        const auto newrow = [&](size_t row) { return reinterpret_cast<const ImageBGRA *>(newstart + row * newstride); };
+
+        // a different set of rows every frame, so a change that is missed now is found within SampleRows frames
+        const auto phase = context.SamplePhase++ % stride;
+        auto changed = false;
+        if (oldImage) {
+            const auto oldstride = width * sizeof(ImageBGRA) + oldImage->BytesToNextRow;
+            const auto oldstart = reinterpret_cast<const unsigned char *>(StartSrc(*oldImage));
+            const auto oldrow = [&](size_t row) { return reinterpret_cast<const ImageBGRA *>(oldstart + row * oldstride); };
+            const auto tilewidth = static_cast<size_t>(options.TileWidth);
+            for (auto row = phase; !changed && row < height; row += stride) {
+                if (!tiled) {
+                    changed = Compare(kernels, options, oldrow(row), newrow(row), width);
+                    continue;
+                }
+                // each tile holds a piece of the row
+                const auto tiles = reinterpret_cast<const ImageBGRA *>(oldstart);
+                for (size_t left = 0; !changed && left < width; left += tilewidth) {
+                    changed = Compare(kernels, options, tiles + TiledOffset(row, left, width, height, options), newrow(row) + left,
+                                      std::min(tilewidth, width - left));
+                }
+            }
+        }
+        else {
+            // there is nothing to compare against, but the rows can be compared through a checksum with the last time the same rows were checked
+            if (context.SampleChecksums.size() != stride) {
+                context.SampleChecksums.assign(stride, 0);
+                context.HasSampleChecksums.assign(stride, 0);
+            }
+            uint64_t checksum = 0;
+            for (auto row = phase; row < height; row += stride) {
+                checksum = kernels.Hash(checksum, newrow(row), width);
+            }
+            changed = !context.HasSampleChecksums[phase] || checksum != context.SampleChecksums[phase];
+            context.SampleChecksums[phase] = checksum;
+            context.HasSampleChecksums[phase] = 1;
+        }
+        if (!changed && options.FullScanInterval > 0 && context.SkippedFrames >= options.FullScanInterval) {
+            changed = true; // catches the changes the samples missed
+        }
+        context.SkippedFrames = changed ? 0 : context.SkippedFrames + 1;
+        return changed;
+    }
+
+    // calls getdifs for bands of tile rows, spread across the workers when there are any
+    template <class F>
+    static const std::vector<ImageRect> &GetDifs(DiffContext &context, const Image &newImage, const DiffOptions &options, WorkerPool *workers,
+                                                 const F &getdifs)
+    {
+        assert(options.TileWidth > 0 && options.TileHeight > 0);
+        const auto tilerows = static_cast<size_t>(TileRows(Rect(newImage), options));
+        const auto tilecols = static_cast<size_t>(TileColumns(Rect(newImage), options));
+
+        TileChanges changes{context, tilerows, tilecols, options};
+        // the damage only describes this frame
+        context.HasDamage = false;
+        context.Damage.clear();
+
+        const auto bands = workers ? std::min(tilerows, static_cast<size_t>(options.Threads)) : 1;
+        if (bands > 1) {
+            // each band is a contiguous run of tile rows, so each one writes to its own rows of the change map and of the old image
+            workers->Run(bands, [&](size_t band) { getdifs(changes, tilerows * band / bands, tilerows * (band + 1) / bands); });
+        }
+        else {
+            getdifs(changes, 0, tilerows);
+        }
+
+        if (options.HeatDecay > 0.0f) {
+            UpdateHeat(context, changes, options);
+        }
+        auto &rects = context.Rects;
+        GetRects(rects, changes, options.TileWidth, options.TileHeight);
+        merge(rects, context.MergedRects, context.MergeColumns, options.TileWidth, tilecols);
         SanitizeRects(rects, newImage);
+        merge(rects, context, options);
         return rects;
     }
 
+    std::vector<ImageRect> GetDifs(const Image &oldImage, const Image &newImage, const DiffOptions &options, WorkerPool *workers)
+    {
+        DiffContext context;
+        return GetDifs(context, oldImage, newImage, options, workers);
+    }
+
+    // the diff of a frame MightHaveChanged found nothing in. This still clears the changes of the last frame and lets hot tiles cool down
+    static const std::vector<ImageRect> &Unchanged(DiffContext &context, const Image &newImage, const DiffOptions &options)
+    {
+        context.Moves.clear();
+        return GetDifs(context, newImage, options, nullptr, [](TileChanges &, size_t, size_t) {});
+    }
+
+    const std::vector<ImageRect> &GetDifs(DiffContext &context, const Image &oldImage, const Image &newImage, const DiffOptions &options,
+                                          WorkerPool *workers)
+    {
+        if (!MightHaveChanged(context, &oldImage, newImage, options)) {
+            return Unchanged(context, newImage, options);
+        }
+        context.Moves.clear();
+        return GetDifs(context, newImage, options, workers, [&](TileChanges &changes, size_t firsttilerow, size_t lasttilerow) {
+            GetDifs(changes, oldImage, nullptr, newImage, options, firsttilerow, lasttilerow);
+        });
+    }
+
+    const std::vector<ImageRect> &GetDifsAndUpdate(DiffContext &context, unsigned char *oldimg, const Image &newImage, const DiffOptions &options,
+                                                   WorkerPool *workers)
+    {
+        auto oldImage = CreateImage(Rect(newImage), 0, reinterpret_cast<const ImageBGRA *>(oldimg));
+        const auto tiled = options.Reference == DiffReference::TiledPixels;
+        if (!MightHaveChanged(context, &oldImage, newImage, options, tiled)) {
+            return Unchanged(context, newImage, options);
+        }
+        if (tiled) {
+            context.Moves.clear(); // moves are applied a row at a time, so they need the previous frame kept row by row
+            return GetDifs(context, newImage, options, workers, [&](TileChanges &changes, size_t firsttilerow, size_t lasttilerow) {
+                GetTiledDifs(changes, oldimg, newImage, options, firsttilerow, lasttilerow);
+            });
+        }
+        FindMoves(context, oldimg, newImage, options);
+        return GetDifs(context, newImage, options, workers, [&](TileChanges &changes, size_t firsttilerow, size_t lasttilerow) {
+            GetDifs(changes, oldImage, oldimg, newImage, options, firsttilerow, lasttilerow);
+        });
+    }
+
+    const std::vector<ImageRect> &GetHashDifsAndUpdate(DiffContext &context, unsigned char *oldimg, const Image &newImage,
+                                                       const DiffOptions &options, WorkerPool *workers)
+    {
+        const auto tilecount = TileCount(Rect(newImage), options);
+        context.TileHashes.resize(tilecount);
+        context.NewTileHashes.resize(tilecount);
+        const auto oldImage = CreateImage(Rect(newImage), 0, reinterpret_cast<const ImageBGRA *>(oldimg));
+        if (!MightHaveChanged(context, oldimg ? &oldImage : nullptr, newImage, options)) {
+            return Unchanged(context, newImage, options);
+        }
+        context.Moves.clear();
+        return GetDifs(context, newImage, options, workers, [&](TileChanges &changes, size_t firsttilerow, size_t lasttilerow) {
+            GetHashDifs(changes, context.TileHashes.data(), context.NewTileHashes.data(), oldimg, newImage, options, firsttilerow, lasttilerow);
+        });
+    }
+
+    void CopyReference(unsigned char *reference, const Image &img, const DiffOptions &options)
+    {
+        const auto width = static_cast<size_t>(Width(img));
+        const auto height = static_cast<size_t>(Height(img));
+        const auto rowsize = width * sizeof(ImageBGRA);
+        const auto stride = rowsize + img.BytesToNextRow;
+        const auto start = reinterpret_cast<const unsigned char *>(StartSrc(img));
+        if (options.Reference == DiffReference::TiledPixels) {
+            const auto tilewidth = static_cast<size_t>(options.TileWidth);
+            for (size_t row = 0; row < height; row++) {
+                for (size_t left = 0; left < width; left += tilewidth) {
+                    memcpy(reference + TiledOffset(row, left, width, height, options) * sizeof(ImageBGRA),
+                           start + row * stride + left * sizeof(ImageBGRA), std::min(tilewidth, width - left) * sizeof(ImageBGRA));
+                }
+            }
+        }
+        else if (img.BytesToNextRow == 0) { // no need for multiple calls, there is no padding here
+            memcpy(reference, start, rowsize * height);
+        }
+        else {
+            for (size_t row = 0; row < height; row++) {
+                memcpy(reference + row * rowsize, start + row * stride, rowsize);
+            }
+        }
+    }
+
+    void AllTilesChanged(DiffContext &context, const ImageRect &rect, const DiffOptions &options)
+    {
+        const auto tilerows = static_cast<size_t>(TileRows(rect, options));
+        const auto tilecols = static_cast<size_t>(TileColumns(rect, options));
+        BitMap<uint64_t> changes{context.ChangedTiles, tilerows, tilecols};
+        for (size_t tilerow = 0; tilerow < tilerows; tilerow++) {
+            for (size_t tilecol = 0; tilecol < tilecols; tilecol++) {
+                changes.set(tilerow, tilecol);
+            }
+        }
+        context.Rects.assign(1, rect);
+        context.Moves.clear();
+        // the whole frame is reported, so nothing that was left out for being too hot is missing any more
+        std::fill(context.HotTiles.begin(), context.HotTiles.end(), static_cast<unsigned char>(0));
+    }
+
     Monitor CreateMonitor(int index, int id, int h, int w, int ox, int oy, const std::string &n, float scaling)
     {
         Monitor ret = {};
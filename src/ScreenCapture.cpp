@@ -1,12 +1,14 @@
 #include "internal/SCCommon.h"
 #include "ScreenCapture.h"
 #include "internal/ThreadManager.h"
+#include "internal/WorkerPool.h"
 #include <algorithm>
 #include <assert.h>
 #include <atomic>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 namespace SL {
@@ -39,6 +41,19 @@ namespace Screen_Capture {
         }
         return true;
     }
+    static bool GetTileHeatMap(TileHeatMaps *heatmaps, size_t key, TileHeatMap &heatmap)
+    {
+        if (!heatmaps) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(heatmaps->Lock);
+        auto found = heatmaps->Maps.find(key);
+        if (found == heatmaps->Maps.end()) {
+            return false;
+        }
+        heatmap = found->second;
+        return true;
+    }
     static bool ScreenCaptureManagerExists = false;
     class ScreenCaptureManager : public IScreenCaptureManager {
         
@@ -111,6 +126,14 @@ namespace Screen_Capture {
         virtual void pause() override { Thread_Data_->CommonData_.Paused = true; }
         virtual bool isPaused() const override { return Thread_Data_->CommonData_.Paused; }
         virtual void resume() override { Thread_Data_->CommonData_.Paused = false; }
+        virtual bool getTileHeatMap(const Monitor &monitor, TileHeatMap &heatmap) const override
+        {
+            return GetTileHeatMap(Thread_Data_->ScreenCaptureData.HeatMaps.get(), HeatMapKey(monitor), heatmap);
+        }
+        virtual bool getTileHeatMap(const Window &window, TileHeatMap &heatmap) const override
+        {
+            return GetTileHeatMap(Thread_Data_->WindowCaptureData.HeatMaps.get(), HeatMapKey(window), heatmap);
+        }
     };
 
     class ScreenCaptureConfiguration : public ICaptureConfiguration<ScreenCaptureCallback> {
@@ -131,15 +154,84 @@ namespace Screen_Capture {
             Impl_->Thread_Data_->ScreenCaptureData.OnFrameChanged = cb;
             return std::make_shared<ScreenCaptureConfiguration>(Impl_);
         }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> onFrameDirtyRegions(const ScreenDirtyRegionsCallback &cb) override
+        {
+            assert(!Impl_->Thread_Data_->ScreenCaptureData.OnFrameDirtyRegions);
+            Impl_->Thread_Data_->ScreenCaptureData.OnFrameDirtyRegions = cb;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
         virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> onMouseChanged(const MouseCallback &cb) override
         {
             assert(!Impl_->Thread_Data_->ScreenCaptureData.OnMouseChanged);
             Impl_->Thread_Data_->ScreenCaptureData.OnMouseChanged = cb;
             return std::make_shared<ScreenCaptureConfiguration>(Impl_);
         }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffTileSize(int width, int height) override
+        {
+            assert(width > 0 && height > 0);
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.TileWidth = width;
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.TileHeight = height;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffThreads(int threads) override
+        {
+            assert(threads > 0);
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.Threads = threads;
+            // the calling capture thread works on its own frame as well
+            Impl_->Thread_Data_->ScreenCaptureData.DiffWorkers = threads > 1 ? std::make_shared<WorkerPool>(threads - 1) : nullptr;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffReference(DiffReference reference) override
+        {
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.Reference = reference;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffTightRects(bool enabled) override
+        {
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.TightRects = enabled;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffThreshold(int threshold) override
+        {
+            assert(threshold >= 0 && threshold <= 255);
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.Threshold = static_cast<unsigned char>(threshold);
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffRectMerging(int maxrects, float maxoverdraw) override
+        {
+            assert(maxrects >= 0 && maxoverdraw >= 1.0f);
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.MaxRects = maxrects;
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.MaxOverdraw = maxoverdraw;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffMoveDetection(DiffMoves moves) override
+        {
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.Moves = moves;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffSampling(int rowstride, int fullscaninterval) override
+        {
+            assert(rowstride >= 0 && fullscaninterval >= 0);
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.SampleRows = rowstride;
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.FullScanInterval = fullscaninterval;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setDiffHeatMap(float decay, float maxheat) override
+        {
+            assert(decay >= 0.0f && decay < 1.0f);
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.HeatDecay = decay;
+            Impl_->Thread_Data_->ScreenCaptureData.Diff.MaxHeat = maxheat;
+            Impl_->Thread_Data_->ScreenCaptureData.HeatMaps = decay > 0.0f ? std::make_shared<TileHeatMaps>() : nullptr;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<ScreenCaptureCallback>> setSingleGrab(bool enabled) override
+        {
+            Impl_->Thread_Data_->ScreenCaptureData.SingleGrab = enabled;
+            return std::make_shared<ScreenCaptureConfiguration>(Impl_);
+        }
         virtual std::shared_ptr<IScreenCaptureManager> start_capturing() override
         {
-            assert(Impl_->Thread_Data_->ScreenCaptureData.OnMouseChanged || Impl_->Thread_Data_->ScreenCaptureData.OnFrameChanged ||
+            assert(Impl_->Thread_Data_->ScreenCaptureData.OnMouseChanged || WantsDifs(Impl_->Thread_Data_->ScreenCaptureData) ||
                    Impl_->Thread_Data_->ScreenCaptureData.OnNewFrame);
             Impl_->start();
             return Impl_;
@@ -164,6 +256,12 @@ namespace Screen_Capture {
             Impl_->Thread_Data_->WindowCaptureData.OnFrameChanged = cb;
             return std::make_shared<WindowCaptureConfiguration>(Impl_);
         }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> onFrameDirtyRegions(const WindowDirtyRegionsCallback &cb) override
+        {
+            assert(!Impl_->Thread_Data_->WindowCaptureData.OnFrameDirtyRegions);
+            Impl_->Thread_Data_->WindowCaptureData.OnFrameDirtyRegions = cb;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
         virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> onMouseChanged(const MouseCallback &cb) override
         {
 
@@ -171,9 +269,71 @@ namespace Screen_Capture {
             Impl_->Thread_Data_->WindowCaptureData.OnMouseChanged = cb;
             return std::make_shared<WindowCaptureConfiguration>(Impl_);
         }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffTileSize(int width, int height) override
+        {
+            assert(width > 0 && height > 0);
+            Impl_->Thread_Data_->WindowCaptureData.Diff.TileWidth = width;
+            Impl_->Thread_Data_->WindowCaptureData.Diff.TileHeight = height;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffThreads(int threads) override
+        {
+            assert(threads > 0);
+            Impl_->Thread_Data_->WindowCaptureData.Diff.Threads = threads;
+            Impl_->Thread_Data_->WindowCaptureData.DiffWorkers = threads > 1 ? std::make_shared<WorkerPool>(threads - 1) : nullptr;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffReference(DiffReference reference) override
+        {
+            Impl_->Thread_Data_->WindowCaptureData.Diff.Reference = reference;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffTightRects(bool enabled) override
+        {
+            Impl_->Thread_Data_->WindowCaptureData.Diff.TightRects = enabled;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffThreshold(int threshold) override
+        {
+            assert(threshold >= 0 && threshold <= 255);
+            Impl_->Thread_Data_->WindowCaptureData.Diff.Threshold = static_cast<unsigned char>(threshold);
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffRectMerging(int maxrects, float maxoverdraw) override
+        {
+            assert(maxrects >= 0 && maxoverdraw >= 1.0f);
+            Impl_->Thread_Data_->WindowCaptureData.Diff.MaxRects = maxrects;
+            Impl_->Thread_Data_->WindowCaptureData.Diff.MaxOverdraw = maxoverdraw;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffMoveDetection(DiffMoves moves) override
+        {
+            Impl_->Thread_Data_->WindowCaptureData.Diff.Moves = moves;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffSampling(int rowstride, int fullscaninterval) override
+        {
+            assert(rowstride >= 0 && fullscaninterval >= 0);
+            Impl_->Thread_Data_->WindowCaptureData.Diff.SampleRows = rowstride;
+            Impl_->Thread_Data_->WindowCaptureData.Diff.FullScanInterval = fullscaninterval;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setDiffHeatMap(float decay, float maxheat) override
+        {
+            assert(decay >= 0.0f && decay < 1.0f);
+            Impl_->Thread_Data_->WindowCaptureData.Diff.HeatDecay = decay;
+            Impl_->Thread_Data_->WindowCaptureData.Diff.MaxHeat = maxheat;
+            Impl_->Thread_Data_->WindowCaptureData.HeatMaps = decay > 0.0f ? std::make_shared<TileHeatMaps>() : nullptr;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
+        virtual std::shared_ptr<ICaptureConfiguration<WindowCaptureCallback>> setSingleGrab(bool enabled) override
+        {
+            Impl_->Thread_Data_->WindowCaptureData.SingleGrab = enabled;
+            return std::make_shared<WindowCaptureConfiguration>(Impl_);
+        }
         virtual std::shared_ptr<IScreenCaptureManager> start_capturing() override
         {
-            assert(Impl_->Thread_Data_->WindowCaptureData.OnMouseChanged || Impl_->Thread_Data_->WindowCaptureData.OnFrameChanged ||
+            assert(Impl_->Thread_Data_->WindowCaptureData.OnMouseChanged || WantsDifs(Impl_->Thread_Data_->WindowCaptureData) ||
                    Impl_->Thread_Data_->WindowCaptureData.OnNewFrame);
             Impl_->start();
             return Impl_;
@@ -0,0 +1,79 @@
+#include "internal/WorkerPool.h"
+#include <algorithm>
+
+namespace SL {
+namespace Screen_Capture {
+
+    WorkerPool::WorkerPool(size_t threads)
+    {
+        Threads.reserve(threads);
+        for (size_t i = 0; i < threads; i++) {
+            Threads.emplace_back(&WorkerPool::WorkerLoop, this);
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Stopping = true;
+        }
+        JobAdded.notify_all();
+        for (auto &t : Threads) {
+            t.join();
+        }
+    }
+
+    void WorkerPool::Work(Job &job)
+    {
+        for (auto i = job.Next++; i < job.Count; i = job.Next++) {
+            job.Work(job.Context, i);
+            job.Done++;
+        }
+    }
+
+    void WorkerPool::WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        while (true) {
+            JobAdded.wait(lock, [&] { return Stopping || !Jobs.empty(); });
+            if (Stopping) {
+                return;
+            }
+            auto job = Jobs.front();
+            if (job->Next >= job->Count) {
+                Jobs.erase(Jobs.begin()); // every piece of this job has been handed out
+                continue;
+            }
+            job->Workers += 1;
+            lock.unlock();
+            Work(*job);
+            lock.lock();
+            // the job is gone as soon as Run sees it done with no workers left
+            if (--job->Workers == 0 && job->Done == job->Count) {
+                JobDone.notify_all();
+            }
+        }
+    }
+
+    void WorkerPool::Run(Job &job)
+    {
+        if (!Threads.empty() && job.Count > 1) {
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                Jobs.push_back(&job);
+            }
+            JobAdded.notify_all();
+        }
+        Work(job);
+
+        // once the job is out of Jobs no more pool threads can start on it
+        std::unique_lock<std::mutex> lock(Mutex);
+        auto found = std::find(Jobs.begin(), Jobs.end(), &job);
+        if (found != Jobs.end()) {
+            Jobs.erase(found);
+        }
+        JobDone.wait(lock, [&] { return job.Done == job.Count && job.Workers == 0; });
+    }
+} // namespace Screen_Capture
+} // namespace SL
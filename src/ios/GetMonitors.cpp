@@ -1,6 +1,7 @@
 #include "ScreenCapture.h"
 #include "internal/SCCommon.h"
 #include <ApplicationServices/ApplicationServices.h>
+#include <atomic>
 
 
 namespace SL{
@@ -33,5 +34,9 @@ namespace SL{
             return ret;
 
         }
+        uint64_t MonitorsGeneration() {
+            static std::atomic<uint64_t> generation{0};
+            return ++generation;
+        }
     }
 }
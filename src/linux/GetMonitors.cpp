@@ -1,26 +1,30 @@
 #include "ScreenCapture.h"
 #include "internal/SCCommon.h"
+#include "X11Connection.h"
 #include <X11/Xlib.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
+#include <atomic>
 #include <dlfcn.h>
+#include <mutex>
+#include <poll.h>
+#include <thread>
 
 namespace SL
 {
 namespace Screen_Capture
 {
 
-    std::vector<Monitor> GetMonitors()
+    static std::vector<Monitor> QueryMonitors(Display* display)
     {
       std::vector<Monitor> ret;
 
-        Display* display = XOpenDisplay(NULL);
         if(display==NULL){
             return ret;
         }
         int nmonitors = 0;
         XineramaScreenInfo* screen = XineramaQueryScreens(display, &nmonitors);
          if(screen==NULL){ 
-            XCloseDisplay(display);
             return ret;
         }
         ret.reserve(nmonitors);
@@ -32,8 +36,94 @@ namespace Screen_Capture
                 i, screen[i].screen_number, screen[i].height, screen[i].width, screen[i].x_org, screen[i].y_org, name, 1.0f));
         }
         XFree(screen);
-        XCloseDisplay(display);
         return ret;
     }
+
+    // Opening a connection to the X server for every call is expensive, and the capture threads ask for the monitors every frame. The monitors
+    // are only queried again after RandR says the screen changed. A thread waits for those events on its own connection and bumps Generation.
+    // The cache also holds on to the shared connection, so it is still open when the capture is restarted.
+    class MonitorCache {
+        std::mutex Lock;
+        std::shared_ptr<Display> Connection;
+        std::vector<Monitor> Monitors;
+        uint64_t MonitorsGeneration = 0;
+        bool HasMonitors = false;
+
+        std::atomic<uint64_t> Generation{1};
+        std::atomic<bool> Stop{false};
+        bool Listening = false;
+        Display* ListenerDisplay = nullptr;
+        std::thread Listener;
+
+        void Listen(int eventbase)
+        {
+            pollfd fd = {ConnectionNumber(ListenerDisplay), POLLIN, 0};
+            while(!Stop) {
+                while(XPending(ListenerDisplay)) {
+                    XEvent ev;
+                    XNextEvent(ListenerDisplay, &ev);
+                    if(ev.type == eventbase + RRScreenChangeNotify || ev.type == eventbase + RRNotify) {
+                        XRRUpdateConfiguration(&ev);
+                        Generation += 1;
+                    }
+                }
+                poll(&fd, 1, 100); // wakes up now and then to see if it should stop
+            }
+        }
+
+    public:
+        MonitorCache()
+        {
+            Connection = GetX11Connection();
+            ListenerDisplay = XOpenDisplay(NULL);
+            int eventbase = 0, errorbase = 0;
+            if(ListenerDisplay && XRRQueryExtension(ListenerDisplay, &eventbase, &errorbase)) {
+                XRRSelectInput(ListenerDisplay, DefaultRootWindow(ListenerDisplay),
+                               RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask | RROutputChangeNotifyMask);
+                Listening = true;
+                Listener = std::thread([this, eventbase]() { Listen(eventbase); });
+            }
+        }
+        ~MonitorCache()
+        {
+            Stop = true;
+            if(Listener.joinable()) {
+                Listener.join();
+            }
+            if(ListenerDisplay) {
+                XCloseDisplay(ListenerDisplay);
+            }
+        }
+        uint64_t generation()
+        {
+            // without RandR there is no way to tell, so the monitors always have to be checked
+            return Listening ? Generation.load() : Generation++;
+        }
+        std::vector<Monitor> monitors()
+        {
+            // read before the query, so a change while querying is seen by the next call
+            const auto generation = Generation.load();
+            std::lock_guard<std::mutex> lock(Lock);
+            if(!Listening || !HasMonitors || MonitorsGeneration != generation) {
+                if(!Connection) {
+                    Connection = GetX11Connection();
+                }
+                Monitors = QueryMonitors(Connection.get());
+                MonitorsGeneration = generation;
+                HasMonitors = true;
+            }
+            return Monitors;
+        }
+    };
+
+    static MonitorCache& GetMonitorCache()
+    {
+        static MonitorCache cache;
+        return cache;
+    }
+
+    std::vector<Monitor> GetMonitors() { return GetMonitorCache().monitors(); }
+
+    uint64_t MonitorsGeneration() { return GetMonitorCache().generation(); }
 }
 }
@@ -1,5 +1,6 @@
 #include "ScreenCapture.h"
 #include "internal/SCCommon.h"
+#include "X11Connection.h"
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <algorithm>
@@ -118,7 +119,12 @@ namespace Screen_Capture
 
     std::vector<Window> GetWindows()
     {
-        auto* display = XOpenDisplay(NULL);
+        std::vector<Window> ret;
+        auto connection = GetX11Connection();
+        if(!connection) {
+            return ret;
+        }
+        auto* display = connection.get();
         Atom a = XInternAtom(display, "_NET_CLIENT_LIST", true);
         Atom actualType;
         int format;
@@ -136,7 +142,6 @@ namespace Screen_Capture
                                         &numItems,
                                         &bytesAfter,
                                         &data);
-        std::vector<Window> ret;
         if(status >= Success && numItems) {
             auto array = (XID*)data;
             for(decltype(numItems) k = 0; k < numItems; k++) {
@@ -145,7 +150,6 @@ namespace Screen_Capture
             }
             XFree(data);
         }
-        XCloseDisplay(display);
         return ret;
     }
 }
@@ -2,6 +2,9 @@
 #include "internal/ThreadManager.h"
 #include "X11FrameProcessor.h"
 #include "X11MouseProcessor.h"
+#ifdef SC_LITE_XCB
+#include "XCBFrameProcessor.h"
+#endif
 
 namespace SL{
     namespace Screen_Capture{	
@@ -9,6 +12,13 @@ namespace SL{
             TryCaptureMouse<X11MouseProcessor>(data);
         }
         void RunCaptureMonitor(std::shared_ptr<Thread_Data> data, Monitor monitor){
+#ifdef SC_LITE_XCB
+            // the single grab is shared by X11FrameProcessors
+            if (!data->ScreenCaptureData.SingleGrab) {
+                TryCaptureMonitor<XCBFrameProcessor>(data, monitor);
+                return;
+            }
+#endif
             TryCaptureMonitor<X11FrameProcessor>(data, monitor);
         }
         void RunCaptureWindow(std::shared_ptr<Thread_Data> data, Window window){
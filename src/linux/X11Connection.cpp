@@ -0,0 +1,30 @@
+#include "X11Connection.h"
+#include <mutex>
+
+namespace SL
+{
+namespace Screen_Capture
+{
+    std::shared_ptr<Display> GetX11Connection()
+    {
+        static std::once_flag initthreads;
+        static std::mutex lock;
+        static std::weak_ptr<Display> connection;
+
+        // every thread uses the same connection, so xlib has to lock it. This must be done before anything else talks to the X server
+        std::call_once(initthreads, []() { XInitThreads(); });
+
+        std::lock_guard<std::mutex> guard(lock);
+        auto display = connection.lock();
+        if(!display) {
+            auto opened = XOpenDisplay(NULL);
+            if(!opened) {
+                return display;
+            }
+            display = std::shared_ptr<Display>(opened, [](Display* d) { XCloseDisplay(d); });
+            connection = display;
+        }
+        return display;
+    }
+}
+}
@@ -1,5 +1,6 @@
 #include "X11FrameProcessor.h"
 #include <X11/Xutil.h> 
+#include <algorithm>
 #include <assert.h>
 #include <vector>
 
@@ -13,17 +14,20 @@ namespace Screen_Capture
 
     X11FrameProcessor::~X11FrameProcessor()
     {
-
-        if(ShmInfo) {
-            shmdt(ShmInfo->shmaddr);
-            shmctl(ShmInfo->shmid, IPC_RMID, 0);
-            XShmDetach(SelectedDisplay, ShmInfo.get());
+        if(WindowPixmap) {
+            XFreePixmap(SelectedDisplay, WindowPixmap);
         }
-        if(XImage_) {
-            XDestroyImage(XImage_);
+        if(Composited) {
+            XCompositeUnredirectWindow(SelectedDisplay, SelectedWindow, CompositeRedirectAutomatic);
+        }
+        if(Damage_) {
+            XDamageDestroy(SelectedDisplay, Damage_);
+            XFixesDestroyRegion(SelectedDisplay, DamageRegion);
         }
+        DestroyImage();
         if(SelectedDisplay) {
-            XCloseDisplay(SelectedDisplay);
+            // the connection is shared and might stay open, so the requests above have to be sent now
+            XFlush(SelectedDisplay);
         }
     }
     
@@ -31,41 +35,107 @@ namespace Screen_Capture
         
         auto ret = DUPL_RETURN::DUPL_RETURN_SUCCESS;
         Data = data; 
-        SelectedDisplay = XOpenDisplay(NULL);
+        Connection = GetX11Connection();
+        SelectedDisplay = Connection.get();
         SelectedWindow = selectedwindow.Handle;
         if(!SelectedDisplay) {
             return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;
         }
         int scr = XDefaultScreen(SelectedDisplay);
+        WindowVisual = DefaultVisual(SelectedDisplay, scr);
+        WindowDepth = DefaultDepth(SelectedDisplay, scr);
 
+        // the pixmap of a window can only be named with composite 0.2 and up
+        int eventbase = 0, errorbase = 0, major = 0, minor = 2;
+        XWindowAttributes wndattr;
+        if(XCompositeQueryExtension(SelectedDisplay, &eventbase, &errorbase) && XCompositeQueryVersion(SelectedDisplay, &major, &minor) &&
+           (major > 0 || minor >= 2) && XGetWindowAttributes(SelectedDisplay, SelectedWindow, &wndattr)) {
+            // automatic redirection can be asked for by any number of clients, so this works alongside a compositing window manager
+            XCompositeRedirectWindow(SelectedDisplay, SelectedWindow, CompositeRedirectAutomatic);
+            Composited = true;
+            // the pixmap has the depth of the window, which can be different from the screen
+            WindowVisual = wndattr.visual;
+            WindowDepth = wndattr.depth;
+        }
+        CreateWindowImage(selectedwindow.Size.x, selectedwindow.Size.y);
+        InitDamage(SelectedWindow);
+
+        return ret;
+    }
+
+    void X11FrameProcessor::CreateWindowImage(int width, int height)
+    {
         ShmInfo = std::make_unique<XShmSegmentInfo>();
 
         XImage_ = XShmCreateImage(SelectedDisplay,
-                                DefaultVisual(SelectedDisplay, scr),
-                                DefaultDepth(SelectedDisplay, scr),
+                                WindowVisual,
+                                WindowDepth,
                                 ZPixmap,
                                 NULL,
                                 ShmInfo.get(),
-                                selectedwindow.Size.x,
-                                selectedwindow.Size.y);
+                                width,
+                                height);
         ShmInfo->shmid = shmget(IPC_PRIVATE, XImage_->bytes_per_line * XImage_->height, IPC_CREAT | 0777);
 
         ShmInfo->readOnly = False;
         ShmInfo->shmaddr = XImage_->data = (char*)shmat(ShmInfo->shmid, 0, 0);
 
         XShmAttach(SelectedDisplay, ShmInfo.get());
+    }
 
-        return ret;
+    void X11FrameProcessor::DestroyImage()
+    {
+        if(ShmInfo) {
+            shmdt(ShmInfo->shmaddr);
+            shmctl(ShmInfo->shmid, IPC_RMID, 0);
+            XShmDetach(SelectedDisplay, ShmInfo.get());
+            ShmInfo.reset();
+        }
+        if(XImage_) {
+            XDestroyImage(XImage_);
+            XImage_ = nullptr;
+        }
+    }
+
+    // the grab and the previous frame are made to fit the new size and everything known about the previous frame is thrown away, so the next
+    // frame is sent in full as if capturing had just started. The other captures carry on without noticing
+    void X11FrameProcessor::ResizeWindow(Window& selectedwindow, int width, int height)
+    {
+        DestroyImage();
+        CreateWindowImage(width, height);
+        if(WindowPixmap) { // the window got a new pixmap of the new size
+            XFreePixmap(SelectedDisplay, WindowPixmap);
+            WindowPixmap = 0;
+        }
+        selectedwindow.Size = Point{width, height};
+        ImageBufferSize = width * height * sizeof(ImageBGRA);
+        if(ImageBuffer) {
+            ImageBuffer = std::make_unique<unsigned char[]>(ImageBufferSize);
+        }
+        DiffState = DiffContext();
+        FirstRun = true;
+        GrabAll = true;
     }
     DUPL_RETURN X11FrameProcessor::Init(std::shared_ptr<Thread_Data> data, Monitor& monitor)
     {
         auto ret = DUPL_RETURN::DUPL_RETURN_SUCCESS;
         Data = data;
         SelectedMonitor = monitor;
-        SelectedDisplay = XOpenDisplay(NULL);
+        Connection = GetX11Connection();
+        SelectedDisplay = Connection.get();
         if(!SelectedDisplay) {
             return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;
         }
+        if(Data->ScreenCaptureData.SingleGrab) {
+            // the damage is not used, the shared grab can be older than this monitor's damage so changes could be missed
+            RootGrab = GetX11RootGrab(Data.get());
+            if(!RootGrab || OffsetX(SelectedMonitor) < 0 || OffsetY(SelectedMonitor) < 0 ||
+               OffsetX(SelectedMonitor) + Width(SelectedMonitor) > RootGrab->Width() ||
+               OffsetY(SelectedMonitor) + Height(SelectedMonitor) > RootGrab->Height()) {
+                return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED; // the monitor is not inside the grab, the screen is changing
+            }
+            return ret;
+        }
         int scr = XDefaultScreen(SelectedDisplay);
 
         ShmInfo = std::make_unique<XShmSegmentInfo>();
@@ -84,19 +154,124 @@ namespace Screen_Capture
         ShmInfo->shmaddr = XImage_->data = (char*)shmat(ShmInfo->shmid, 0, 0);
 
         XShmAttach(SelectedDisplay, ShmInfo.get());
+        InitDamage(RootWindow(SelectedDisplay, scr));
 
         return ret;
     }
+
+    void X11FrameProcessor::InitDamage(Drawable drawable)
+    {
+        int errorbase = 0;
+        if(!XDamageQueryExtension(SelectedDisplay, &DamageEventBase, &errorbase)) {
+            return; // every frame is grabbed and looked at in full
+        }
+        // only one notify event is sent each time the damage goes from empty to not empty, the damage itself is read from the region
+        Damage_ = XDamageCreate(SelectedDisplay, drawable, XDamageReportNonEmpty);
+        DamageRegion = XFixesCreateRegion(SelectedDisplay, nullptr, 0);
+    }
+
+    // moves the damage since the last call into DiffState.Damage, relative to bounds which is in the coordinates of the damaged drawable.
+    // Returns false when there is nothing new to grab
+    bool X11FrameProcessor::GetDamage(const ImageRect& bounds)
+    {
+        if(!Damage_) {
+            return true;
+        }
+        // the damage is taken before the grab, anything drawn after this is grabbed again next frame
+        XDamageSubtract(SelectedDisplay, Damage_, None, DamageRegion);
+        int count = 0;
+        auto rects = XFixesFetchRegion(SelectedDisplay, DamageRegion, &count);
+        // the notify events are not needed, but they would pile up. The connection is shared with the other capture threads, so only damage
+        // events are taken and never with a call that could wait for one that another thread already took
+        XEvent ev;
+        while(XCheckTypedEvent(SelectedDisplay, DamageEventBase + XDamageNotify, &ev)) {
+        }
+        // this does not depend on the diff, so it also saves grabbing when only onNewFrame is set. The first diff ignores the damage anyway
+        DiffState.HasDamage = !GrabAll;
+        DiffState.Damage.clear();
+        for(auto i = 0; rects && i < count; i++) {
+            ImageRect rect(std::max<int>(rects[i].x, bounds.left) - bounds.left,
+                           std::max<int>(rects[i].y, bounds.top) - bounds.top,
+                           std::min<int>(rects[i].x + rects[i].width, bounds.right) - bounds.left,
+                           std::min<int>(rects[i].y + rects[i].height, bounds.bottom) - bounds.top);
+            if(rect.right > rect.left && rect.bottom > rect.top) {
+                DiffState.Damage.push_back(rect);
+            }
+        }
+        if(rects) {
+            XFree(rects);
+        }
+        return !DiffState.HasDamage || !DiffState.Damage.empty();
+    }
  
+    // the most separate runs of rows grabbed in a frame, every grab waits for a reply so past this all of the damaged rows are grabbed at once
+    static const size_t MaxDamagedRowRuns = 16;
+
+    // grabs the damaged parts of drawable into XImage_, or all of it when there is no damage information. x, y is where XImage_ starts in the
+    // drawable. The server always writes a grab tightly packed, so whole rows are grabbed and each run of rows lands in place in XImage_
+    bool X11FrameProcessor::GrabImage(Drawable drawable, int x, int y)
+    {
+        if(!DiffState.HasDamage) {
+            GrabAll = !XShmGetImage(SelectedDisplay, drawable, XImage_, x, y, AllPlanes);
+            return !GrabAll;
+        }
+        DamagedRows.clear();
+        for(auto& rect : DiffState.Damage) {
+            DamagedRows.emplace_back(rect.top, rect.bottom);
+        }
+        std::sort(DamagedRows.begin(), DamagedRows.end());
+        size_t runs = 0;
+        for(auto& rows : DamagedRows) { // rows that overlap or touch are grabbed together
+            if(runs > 0 && rows.first <= DamagedRows[runs - 1].second) {
+                DamagedRows[runs - 1].second = std::max(DamagedRows[runs - 1].second, rows.second);
+            }
+            else {
+                DamagedRows[runs++] = rows;
+            }
+        }
+        DamagedRows.resize(runs);
+        if(DamagedRows.size() > MaxDamagedRowRuns) {
+            DamagedRows.front().second = DamagedRows.back().second;
+            DamagedRows.resize(1);
+        }
+        for(auto& rows : DamagedRows) {
+            // the same shared memory and row size, just fewer rows starting further in
+            XImage part = *XImage_;
+            part.height = rows.second - rows.first;
+            part.data = XImage_->data + rows.first * XImage_->bytes_per_line;
+            if(!XShmGetImage(SelectedDisplay, drawable, &part, x, y + rows.first, AllPlanes)) {
+                GrabAll = true; // the damage is used up, so the rows not grabbed would never be grabbed
+                return false;
+            }
+        }
+        return true;
+    }
+
     DUPL_RETURN X11FrameProcessor::ProcessFrame(const Monitor& curentmonitorinfo)
     {        
         auto Ret = DUPL_RETURN_SUCCESS;
-        if(!XShmGetImage(SelectedDisplay,
-                         RootWindow(SelectedDisplay, DefaultScreen(SelectedDisplay)),
-                         XImage_,
-                         OffsetX(SelectedMonitor),
-                         OffsetY(SelectedMonitor),
-                         AllPlanes)) {
+        if(RootGrab) {
+            auto grab = RootGrab->Acquire(RootGrabGeneration);
+            if(!grab) {
+                return DUPL_RETURN_ERROR_EXPECTED;
+            }
+            // released even when a callback throws, the other monitors wait for it before grabbing again
+            struct ReleaseGrab {
+                X11RootGrab* Grab;
+                ~ReleaseGrab() { Grab->Release(); }
+            } release{RootGrab.get()};
+            // this monitor's part of the grab, read in place
+            auto start = grab + OffsetY(SelectedMonitor) * RootGrab->BytesPerLine() + OffsetX(SelectedMonitor) * sizeof(ImageBGRA);
+            ProcessCapture(Data->ScreenCaptureData, *this, SelectedMonitor, start, RootGrab->BytesPerLine());
+            return Ret;
+        }
+        const auto bounds = ImageRect(OffsetX(SelectedMonitor),
+                                      OffsetY(SelectedMonitor),
+                                      OffsetX(SelectedMonitor) + Width(SelectedMonitor),
+                                      OffsetY(SelectedMonitor) + Height(SelectedMonitor));
+        // when nothing was drawn the shared memory still holds the last frame, so it does not need to be grabbed again
+        if(GetDamage(bounds) &&
+           !GrabImage(RootWindow(SelectedDisplay, DefaultScreen(SelectedDisplay)), OffsetX(SelectedMonitor), OffsetY(SelectedMonitor))) {
             return DUPL_RETURN_ERROR_EXPECTED;
         }
         ProcessCapture(Data->ScreenCaptureData, *this, SelectedMonitor, (unsigned char*)XImage_->data, XImage_->bytes_per_line);
@@ -110,14 +285,26 @@ namespace Screen_Capture
             return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;//window might not be valid any more
         }
         if(wndattr.width != Width(selectedwindow) || wndattr.height != Height(selectedwindow)){
-            return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;//window size changed. This will rebuild everything
-        }
-        if(!XShmGetImage(SelectedDisplay,
-                         selectedwindow.Handle,
-                         XImage_,
-                         0,
-                         0,
-                         AllPlanes)) {
+            ResizeWindow(selectedwindow, wndattr.width, wndattr.height);
+        }
+        if(wndattr.map_state != IsViewable) {
+            // there is nothing to grab while the window is not shown, the last frame stays current
+            if(WindowPixmap) {
+                XFreePixmap(SelectedDisplay, WindowPixmap);
+                WindowPixmap = 0;
+            }
+            return Ret;
+        }
+        Drawable drawable = SelectedWindow;
+        if(Composited) {
+            if(!WindowPixmap) {
+                // a window gets a new pixmap every time it is shown, nothing is known about what is in it
+                WindowPixmap = XCompositeNameWindowPixmap(SelectedDisplay, SelectedWindow);
+                GrabAll = true;
+            }
+            drawable = WindowPixmap;
+        }
+        if(GetDamage(ImageRect(0, 0, Width(selectedwindow), Height(selectedwindow))) && !GrabImage(drawable, 0, 0)) {
             return DUPL_RETURN_ERROR_EXPECTED;
         }
         ProcessCapture(Data->WindowCaptureData, *this, selectedwindow, (unsigned char*)XImage_->data, XImage_->bytes_per_line);
@@ -8,17 +8,13 @@ namespace Screen_Capture {
 
     X11MouseProcessor::X11MouseProcessor() {}
 
-    X11MouseProcessor::~X11MouseProcessor()
-    {
-        if (SelectedDisplay) {
-            XCloseDisplay(SelectedDisplay);
-        }
-    }
+    X11MouseProcessor::~X11MouseProcessor() {}
     DUPL_RETURN X11MouseProcessor::Init(std::shared_ptr<Thread_Data> data)
     {
         auto ret = DUPL_RETURN::DUPL_RETURN_SUCCESS;
         Data = data;
-        SelectedDisplay = XOpenDisplay(NULL);
+        Connection = GetX11Connection();
+        SelectedDisplay = Connection.get();
         if (!SelectedDisplay) {
             return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;
         }
@@ -0,0 +1,117 @@
+#include "X11RootGrab.h"
+#include <X11/Xutil.h>
+#include <map>
+
+namespace SL
+{
+namespace Screen_Capture
+{
+    X11RootGrab::X11RootGrab()
+    {
+    }
+
+    X11RootGrab::~X11RootGrab()
+    {
+        if(ShmInfo.shmaddr) {
+            XShmDetach(Connection.get(), &ShmInfo);
+            shmdt(ShmInfo.shmaddr);
+        }
+        if(XImage_) {
+            XDestroyImage(XImage_);
+        }
+        if(Connection) {
+            XFlush(Connection.get());
+        }
+    }
+
+    bool X11RootGrab::Init()
+    {
+        Connection = GetX11Connection();
+        if(!Connection) {
+            return false;
+        }
+        auto display = Connection.get();
+        int scr = XDefaultScreen(display);
+        // the screen size kept by the connection is not updated when RandR changes it, so the root is asked for its size
+        XWindowAttributes rootattr;
+        if(!XGetWindowAttributes(display, RootWindow(display, scr), &rootattr)) {
+            return false;
+        }
+        XImage_ = XShmCreateImage(display,
+                                  DefaultVisual(display, scr),
+                                  DefaultDepth(display, scr),
+                                  ZPixmap,
+                                  NULL,
+                                  &ShmInfo,
+                                  rootattr.width,
+                                  rootattr.height);
+        if(!XImage_) {
+            return false;
+        }
+        ShmInfo.shmid = shmget(IPC_PRIVATE, XImage_->bytes_per_line * XImage_->height, IPC_CREAT | 0777);
+        if(ShmInfo.shmid == -1) {
+            return false;
+        }
+        ShmInfo.readOnly = False;
+        ShmInfo.shmaddr = XImage_->data = (char*)shmat(ShmInfo.shmid, 0, 0);
+        XShmAttach(display, &ShmInfo);
+        // removed once attached, as in XCBFrameProcessor::CreateBuffer
+        XSync(display, False);
+        shmctl(ShmInfo.shmid, IPC_RMID, 0);
+        return true;
+    }
+
+    const unsigned char* X11RootGrab::Acquire(uint64_t& generation)
+    {
+        std::unique_lock<std::mutex> lock(Lock);
+        while(generation == Generation) {
+            if(Readers == 0) {
+                auto display = Connection.get();
+                auto root = RootWindow(display, DefaultScreen(display));
+                // a root that changed size would make the grab fail with an error that ends the process, the capture is rebuilt instead
+                XWindowAttributes rootattr;
+                if(!XGetWindowAttributes(display, root, &rootattr) || rootattr.width != XImage_->width || rootattr.height != XImage_->height ||
+                   !XShmGetImage(display, root, XImage_, 0, 0, AllPlanes)) {
+                    return nullptr;
+                }
+                Generation += 1;
+            }
+            else {
+                Released.wait(lock);
+            }
+        }
+        generation = Generation;
+        Readers += 1;
+        return reinterpret_cast<const unsigned char*>(XImage_->data);
+    }
+
+    void X11RootGrab::Release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(Lock);
+            Readers -= 1;
+        }
+        Released.notify_all();
+    }
+
+    std::shared_ptr<X11RootGrab> GetX11RootGrab(const void* owner)
+    {
+        static std::mutex lock;
+        static std::map<const void*, std::weak_ptr<X11RootGrab>> grabs;
+
+        std::lock_guard<std::mutex> guard(lock);
+        for(auto it = grabs.begin(); it != grabs.end();) {
+            it = it->second.expired() ? grabs.erase(it) : std::next(it);
+        }
+        auto grab = grabs[owner].lock();
+        if(!grab) {
+            grab = std::make_shared<X11RootGrab>();
+            if(!grab->Init()) {
+                return nullptr;
+            }
+            grabs[owner] = grab;
+        }
+        return grab;
+    }
+}
+}
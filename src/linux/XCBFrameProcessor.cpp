@@ -0,0 +1,132 @@
+#include "XCBFrameProcessor.h"
+#include <X11/Xlib-xcb.h>
+#include <cstdlib>
+#include <sys/shm.h>
+
+namespace SL
+{
+namespace Screen_Capture
+{
+    XCBFrameProcessor::XCBFrameProcessor()
+    {
+    }
+
+    XCBFrameProcessor::~XCBFrameProcessor()
+    {
+        DiscardImage();
+        for(auto& buffer : Buffers) {
+            if(buffer.Segment) {
+                xcb_shm_detach(XCBConnection, buffer.Segment);
+            }
+            if(buffer.Data) {
+                shmdt(buffer.Data);
+            }
+        }
+        if(XCBConnection) {
+            // see ~X11FrameProcessor
+            xcb_flush(XCBConnection);
+        }
+    }
+
+    bool XCBFrameProcessor::CreateBuffer(ShmBuffer& buffer, size_t size)
+    {
+        buffer.Id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0777);
+        if(buffer.Id == -1) {
+            return false;
+        }
+        auto data = shmat(buffer.Id, 0, 0);
+        if(data == (void*)-1) {
+            shmctl(buffer.Id, IPC_RMID, 0);
+            return false;
+        }
+        buffer.Data = static_cast<unsigned char*>(data);
+        buffer.Segment = xcb_generate_id(XCBConnection);
+        auto error = xcb_request_check(XCBConnection, xcb_shm_attach_checked(XCBConnection, buffer.Segment, buffer.Id, 0));
+        // once the server has attached it the segment can be marked for removal, it goes away when both sides detach
+        shmctl(buffer.Id, IPC_RMID, 0);
+        if(error) {
+            free(error);
+            buffer.Segment = 0;
+            return false;
+        }
+        return true;
+    }
+
+    DUPL_RETURN XCBFrameProcessor::Init(std::shared_ptr<Thread_Data> data, Monitor& monitor)
+    {
+        Data = data;
+        SelectedMonitor = monitor;
+        Connection = GetX11Connection();
+        if(!Connection) {
+            return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;
+        }
+        XCBConnection = XGetXCBConnection(Connection.get());
+        Root = DefaultRootWindow(Connection.get());
+
+        auto shm = xcb_get_extension_data(XCBConnection, &xcb_shm_id);
+        if(!shm || !shm->present) {
+            return DUPL_RETURN::DUPL_RETURN_ERROR_UNEXPECTED;
+        }
+        const auto size = static_cast<size_t>(Width(SelectedMonitor)) * Height(SelectedMonitor) * sizeof(ImageBGRA);
+        for(auto& buffer : Buffers) {
+            if(!CreateBuffer(buffer, size)) {
+                return DUPL_RETURN::DUPL_RETURN_ERROR_EXPECTED;
+            }
+        }
+        return DUPL_RETURN::DUPL_RETURN_SUCCESS;
+    }
+
+    void XCBFrameProcessor::RequestImage()
+    {
+        Pending = xcb_shm_get_image(XCBConnection,
+                                    Root,
+                                    static_cast<int16_t>(OffsetX(SelectedMonitor)),
+                                    static_cast<int16_t>(OffsetY(SelectedMonitor)),
+                                    static_cast<uint16_t>(Width(SelectedMonitor)),
+                                    static_cast<uint16_t>(Height(SelectedMonitor)),
+                                    ~0u,
+                                    XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                    Buffers[Current].Segment,
+                                    0);
+        xcb_flush(XCBConnection);
+        HasPending = true;
+    }
+
+    // the reply is thrown away, the server still writes the image but a later request into the same buffer is always handled after it
+    void XCBFrameProcessor::DiscardImage()
+    {
+        if(HasPending) {
+            xcb_discard_reply(XCBConnection, Pending.sequence);
+            HasPending = false;
+        }
+    }
+
+    // a grab requested before a pause would hand out a stale frame when capturing resumes
+    void XCBFrameProcessor::Pause()
+    {
+        DiscardImage();
+    }
+
+    DUPL_RETURN XCBFrameProcessor::ProcessFrame(const Monitor& curentmonitorinfo)
+    {
+        if(!HasPending) {
+            RequestImage();
+        }
+        xcb_generic_error_t* error = nullptr;
+        auto reply = xcb_shm_get_image_reply(XCBConnection, Pending, &error);
+        HasPending = false;
+        if(!reply) {
+            free(error);
+            return DUPL_RETURN_ERROR_EXPECTED;
+        }
+        free(reply);
+
+        const auto ready = Current;
+        Current ^= 1;
+        RequestImage();
+        ProcessCapture(Data->ScreenCaptureData, *this, SelectedMonitor, Buffers[ready].Data,
+                       Width(SelectedMonitor) * static_cast<int>(sizeof(ImageBGRA)));
+        return DUPL_RETURN_SUCCESS;
+    }
+}
+}
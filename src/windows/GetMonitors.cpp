@@ -1,6 +1,7 @@
 #include "ScreenCapture.h"
 #include "internal/SCCommon.h"
 #include <DXGI.h>
+#include <atomic>
 
 namespace SL {
 namespace Screen_Capture {
@@ -67,5 +68,11 @@ namespace Screen_Capture {
         }
         return ret;
     }
+
+    uint64_t MonitorsGeneration()
+    {
+        static std::atomic<uint64_t> generation{0};
+        return ++generation;
+    }
 } // namespace Screen_Capture
 } // namespace SL
\ No newline at end of file